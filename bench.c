@@ -0,0 +1,424 @@
+/*
+ * bench.c - Benchmark harness for the Simple Integer Language
+ * ===========================================================
+ * Generates a program of a chosen size and shape, then times each phase
+ * of running it separately over repeated runs and prints min, median
+ * and 99th percentile, with throughput in MB/s and statements/s.
+ * parser.c is compiled into this file, so its internals can be timed
+ * one by one.
+ *
+ * Compile : gcc -O2 -pthread -o bench bench.c
+ * Run     : ./bench [options]
+ *
+ * Options :
+ *   --decls=N        statements to generate (default 100000)
+ *   --depth=D        depth of each expression tree (default 4)
+ *   --prints=P       percentage of statements that are print() (default 10)
+ *   --seed=S         generator seed (default 1)
+ *   --runs=R         timed runs (default 20)
+ *   --file=PATH      benchmark an existing source file instead
+ *   --emit=PATH      write the generated program to PATH and exit
+ *   --engine=ast|parallel|vm|jit, --no-opt, --checked, --threads=N
+ *                    as for ./parser (default engine: vm)
+ *   --alloc-check    instead of timing, run the file R times on one
+ *                    context and fail if any run after the first
+ *                    allocates (build with -DSIL_STATS; engines direct,
+ *                    ast, vm and jit)
+ *
+ * Check   : gcc -O2 -pthread -DSIL_STATS -o bench bench.c &&
+ *           ./bench --alloc-check --engine=jit
+ *
+ * PHASES
+ * ---------------------------------------------------------------
+ *   read_file      map or read the source
+ *   tokenise       lex the whole source, discarding the tokens
+ *   parse_program  lex and parse into an AST (the lexer is pull-based,
+ *                  so this includes a second lexing pass)
+ *   optimise       constant folding and CSE, unless --no-opt
+ *   compile        bytecode compilation (vm and jit engines)
+ *   execute        run the program; print() output is discarded
+ * ---------------------------------------------------------------
+ */
+
+#define PARSER_NO_MAIN
+#define PARSER_BENCH   /* keep read_file() */
+#include "parser.c"
+
+#include <time.h>
+
+/* ======================== PROGRAM GENERATOR ======================== */
+/*
+ * Statement i is a declaration of v<i> or, with probability P%, a
+ * print().  Expressions are full binary trees of depth D whose leaves
+ * are small literals or recently declared variables.  Divisors are
+ * always non-zero literals, so the program runs without errors.
+ */
+
+typedef struct {
+    char  *data;
+    size_t len, cap;
+} GenBuf;
+
+typedef struct {
+    uint64_t state;
+    int      declared; /* variables v0 .. v<declared - 1> exist */
+} GenState;
+
+static void gen_put(GenBuf *b, const char *s, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap  = (b->len + n) * 2;
+        b->data = (char *)xrealloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static void gen_str(GenBuf *b, const char *s) {
+    gen_put(b, s, strlen(s));
+}
+
+/* xorshift64* */
+static unsigned gen_rand(GenState *g, unsigned n) {
+    g->state ^= g->state >> 12;
+    g->state ^= g->state << 25;
+    g->state ^= g->state >> 27;
+    return (unsigned)((g->state * 0x2545F4914F6CDD1DULL) >> 33) % n;
+}
+
+static void gen_leaf(GenBuf *b, GenState *g) {
+    char tmp[32];
+    if (g->declared > 0 && gen_rand(g, 3) != 0) {
+        int window = g->declared < 64 ? g->declared : 64;
+        snprintf(tmp, sizeof(tmp), "v%d", g->declared - 1 - (int)gen_rand(g, window));
+    } else {
+        snprintf(tmp, sizeof(tmp), "%u", 1 + gen_rand(g, 99));
+    }
+    gen_str(b, tmp);
+}
+
+static void gen_expr(GenBuf *b, GenState *g, int depth) {
+    if (depth == 0) {
+        gen_leaf(b, g);
+        return;
+    }
+    static const char ops[] = "+-*/";
+    char op = ops[gen_rand(g, 4)];
+
+    gen_put(b, "(", 1);
+    gen_expr(b, g, depth - 1);
+    gen_put(b, " ", 1);
+    gen_put(b, &op, 1);
+    gen_put(b, " ", 1);
+    if (op == '/') {
+        char tmp[16];
+        snprintf(tmp, sizeof(tmp), "%u", 1 + gen_rand(g, 9));
+        gen_str(b, tmp);
+    } else {
+        gen_expr(b, g, depth - 1);
+    }
+    gen_put(b, ")", 1);
+}
+
+static void generate(GenBuf *b, int decls, int depth, int prints, unsigned seed) {
+    GenState g = { 0x9E3779B97F4A7C15ULL ^ seed, 0 };
+    char     tmp[32];
+
+    for (int i = 0; i < decls; i++) {
+        if ((int)gen_rand(&g, 100) < prints) {
+            gen_str(b, "print(");
+            gen_expr(b, &g, depth);
+            gen_str(b, ");\n");
+        } else {
+            snprintf(tmp, sizeof(tmp), "int v%d = ", g.declared);
+            gen_str(b, tmp);
+            gen_expr(b, &g, depth);
+            gen_str(b, ";\n");
+            g.declared++;
+        }
+    }
+}
+
+/* ======================== TIMING ======================== */
+
+enum { PH_READ, PH_LEX, PH_PARSE, PH_OPT, PH_COMPILE, PH_EXEC, PH_TOTAL, PH_COUNT };
+
+static const char *const phase_names[PH_COUNT] = {
+    "read_file", "tokenise", "parse_program", "optimise", "compile", "execute", "total"
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of sorted samples */
+static double percentile(const double *sorted, int n, int pct) {
+    int rank = (pct * n + 99) / 100;
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+static void sink_output(void *user, const char *data, size_t len) {
+    (void)user;
+    (void)data;
+    (void)len;
+}
+
+/*
+ * Run the file at path once, storing the time of each phase in t[]
+ * (-1 for a phase that did not run).  Returns 1 if the program
+ * reported errors.
+ */
+static int bench_once(Interp *in, const char *path, double t[PH_COUNT], int *stmts) {
+    double start = now_sec(), t0;
+
+    /* --- read_file --- */
+    t0 = start;
+    SourceFile source;
+    if (read_file(in, path, &source) != 0) return 1;
+    t[PH_READ] = now_sec() - t0;
+
+    /* --- tokenise --- */
+    t0 = now_sec();
+    Token tok;
+    lex_init(in, source.data, source.length);
+    do {
+        if (next_token(in, &tok) != 0) break;
+    } while (tok.type != TOK_EOF);
+    t[PH_LEX] = now_sec() - t0;
+
+    /* --- parse_program --- */
+    t0 = now_sec();
+    Program prog;
+    parser_init(in, source.data, source.length);
+    sym_reset(in);
+    parse_program(in, &prog);
+    t[PH_PARSE] = now_sec() - t0;
+    *stmts = prog.stmt_count;
+
+    /* --- optimise --- */
+    t[PH_OPT] = t[PH_COMPILE] = t[PH_EXEC] = -1;
+    if (!in->had_error && in->opt.optimise) {
+        t0 = now_sec();
+        optimise_program(in, &prog);
+        t[PH_OPT] = now_sec() - t0;
+    }
+
+    /* --- compile and execute --- */
+    if (!in->had_error) {
+        slots_reserve(in, prog.slot_count);
+        if (in->opt.engine == ENGINE_AST || in->opt.engine == ENGINE_PARALLEL) {
+            t0 = now_sec();
+            if (in->opt.engine == ENGINE_AST)
+                exec_program(in, &prog);
+            else
+                exec_parallel(in, &prog);
+            output_flush(in);
+            t[PH_EXEC] = now_sec() - t0;
+        } else {
+            if (!in->code) {
+                in->code = (Bytecode *)xmalloc(sizeof(Bytecode));
+                memset(in->code, 0, sizeof(Bytecode));
+            }
+            t0 = now_sec();
+            compile_program(in, in->code, &prog);
+            t[PH_COMPILE] = now_sec() - t0;
+
+            t0 = now_sec();
+            run_bytecode(in, in->code);
+            output_flush(in);
+            t[PH_EXEC] = now_sec() - t0;
+        }
+    }
+
+    arena_reset(&in->ast_arena);
+    close_source(&source);
+    t[PH_TOTAL] = now_sec() - start;
+    return in->had_error || in->lex_error;
+}
+
+/* ======================== ALLOCATION CHECK ======================== */
+/*
+ * Once a context has run a program, running it again should reuse the
+ * buffers it grew the first time.  Counts the allocations of each run
+ * of the file at path; returns 1 if any run after the first allocated.
+ */
+static int alloc_check(Interp *in, const char *path, int runs) {
+#if SIL_STATS
+    unsigned long first = 0, worst = 0;
+    int failed = 0, worst_run = 0;
+    for (int r = 0; r < runs; r++) {
+        unsigned long before = stat_allocs;
+        SourceFile    source;
+        if (read_file(in, path, &source) != 0) return 1;
+        failed |= run_source(in, source.data, source.length);
+        close_source(&source);
+        unsigned long n = stat_allocs - before;
+        if (r == 0)
+            first = n;
+        else if (n > worst) {
+            worst     = n;
+            worst_run = r + 1;
+        }
+    }
+    printf("allocations: %lu on the first run, ", first);
+    if (worst == 0) {
+        printf("none on the %d after it\n", runs - 1);
+    } else {
+        printf("%lu on run %d\n", worst, worst_run);
+        printf("  FAIL: a repeated run allocated\n");
+    }
+    if (failed) printf("  warning: the program reported errors\n");
+    return worst != 0;
+#else
+    (void)in;
+    (void)path;
+    (void)runs;
+    fprintf(stderr, "Error: --alloc-check needs a build with -DSIL_STATS\n");
+    return 1;
+#endif
+}
+
+/* ======================== MAIN ======================== */
+
+int main(int argc, char *argv[]) {
+    InterpOptions opt    = { ENGINE_VM, 1, 0, 0, 0, NULL, 0, 0, 0, 0 };
+    int           failed = 0;
+    int           decls  = 100000;
+    int           depth  = 4;
+    int           prints = 10;
+    int           runs   = 20;
+    unsigned      seed   = 1;
+    const char   *file   = NULL;
+    const char   *emit   = NULL;
+    int           check  = 0;
+
+    /* --- Check command-line arguments --- */
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--decls=", 8) == 0) {
+            decls = atoi(arg + 8);
+        } else if (strncmp(arg, "--depth=", 8) == 0) {
+            depth = atoi(arg + 8);
+        } else if (strncmp(arg, "--prints=", 9) == 0) {
+            prints = atoi(arg + 9);
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            seed = (unsigned)strtoul(arg + 7, NULL, 10);
+        } else if (strncmp(arg, "--runs=", 7) == 0) {
+            runs = atoi(arg + 7);
+        } else if (strncmp(arg, "--file=", 7) == 0) {
+            file = arg + 7;
+        } else if (strncmp(arg, "--emit=", 7) == 0) {
+            emit = arg + 7;
+        } else if (strcmp(arg, "--engine=direct") == 0) {
+            opt.engine = ENGINE_DIRECT;
+        } else if (strcmp(arg, "--engine=ast") == 0) {
+            opt.engine = ENGINE_AST;
+        } else if (strcmp(arg, "--engine=parallel") == 0) {
+            opt.engine = ENGINE_PARALLEL;
+        } else if (strcmp(arg, "--engine=vm") == 0) {
+            opt.engine = ENGINE_VM;
+        } else if (strcmp(arg, "--engine=jit") == 0 || strcmp(arg, "--jit") == 0) {
+            opt.engine = ENGINE_JIT;
+        } else if (strcmp(arg, "--no-opt") == 0) {
+            opt.optimise = 0;
+        } else if (strcmp(arg, "--checked") == 0) {
+            opt.checked = 1;
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            opt.exec_threads = atoi(arg + 10);
+        } else if (strcmp(arg, "--alloc-check") == 0) {
+            check = 1;
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'\n", arg);
+            return 1;
+        }
+    }
+    if (decls < 0 || depth < 0 || depth > 20 || prints < 0 || prints > 100 || runs < 1) {
+        fprintf(stderr, "Error: --decls, --depth (0-20), --prints (0-100) or --runs out of range\n");
+        return 1;
+    }
+    if (check && (opt.engine == ENGINE_PARALLEL || runs < 2)) {
+        fprintf(stderr, "Error: --alloc-check needs --runs of 2 or more and "
+                        "does not cover the parallel engine\n");
+        return 1;
+    }
+    if (!check && opt.engine == ENGINE_DIRECT) {
+        fprintf(stderr, "Error: the direct engine has no separate phases to time\n");
+        return 1;
+    }
+
+    /* --- Generate the program into a file, so read_file() is timed too --- */
+    char tmp_path[] = "/tmp/sil-bench-XXXXXX";
+    if (!file) {
+        GenBuf b = { NULL, 0, 0 };
+        generate(&b, decls, depth, prints, seed);
+
+        int fd = emit ? open(emit, O_WRONLY | O_CREAT | O_TRUNC, 0644) : mkstemp(tmp_path);
+        if (fd < 0 || write(fd, b.data, b.len) != (ssize_t)b.len) {
+            fprintf(stderr, "Error: cannot write '%s'\n", emit ? emit : tmp_path);
+            return 1;
+        }
+        close(fd);
+        free(b.data);
+        if (emit) return 0;
+        file = tmp_path;
+    }
+
+    Interp *in = (Interp *)xmalloc(sizeof(Interp));
+    interp_init(in, stdout, stderr);
+    in->opt    = opt;
+    in->out_fn = sink_output;
+
+    if (check) {
+        failed = alloc_check(in, file, runs);
+        if (file == tmp_path) unlink(tmp_path);
+        interp_release(in);
+        free(in);
+        return failed;
+    }
+
+    double *samples = (double *)xmalloc((size_t)runs * PH_COUNT * sizeof(double));
+    int     stmts   = 0;
+    for (int r = 0; r < runs; r++) {
+        double t[PH_COUNT];
+        failed |= bench_once(in, file, t, &stmts);
+        for (int p = 0; p < PH_COUNT; p++) samples[p * runs + r] = t[p];
+    }
+
+    struct stat st;
+    double mb = stat(file, &st) == 0 ? (double)st.st_size / (1024.0 * 1024.0) : 0;
+    static const char *const engine_names[] = { "direct", "ast", "vm", "jit", "parallel" };
+
+    /* --- Report --- */
+    printf("%s: %d statements, %.2f MB; engine %s%s%s, %d runs\n",
+           file == tmp_path ? "generated" : file, stmts, mb, engine_names[opt.engine],
+           opt.optimise ? "" : ", no-opt", opt.checked ? ", checked" : "", runs);
+    if (file == tmp_path)
+        printf("  (--decls=%d --depth=%d --prints=%d --seed=%u)\n", decls, depth, prints, seed);
+    if (failed) printf("  warning: the program reported errors\n");
+    printf("%-14s %10s %10s %10s %10s %12s\n",
+           "phase", "min ms", "median ms", "p99 ms", "MB/s", "stmts/s");
+    for (int p = 0; p < PH_COUNT; p++) {
+        double *s = samples + p * runs;
+        qsort(s, runs, sizeof(double), cmp_double);
+        double med = percentile(s, runs, 50);
+        if (med < 0) {
+            printf("%-14s %10s\n", phase_names[p], "-");
+            continue;
+        }
+        printf("%-14s %10.3f %10.3f %10.3f %10.1f %12.0f\n", phase_names[p],
+               s[0] * 1e3, med * 1e3, percentile(s, runs, 99) * 1e3, mb / med, stmts / med);
+    }
+
+    if (file == tmp_path) unlink(tmp_path);
+    free(samples);
+    interp_release(in);
+    free(in);
+    return failed;
+}
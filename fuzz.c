@@ -0,0 +1,911 @@
+/*
+ * fuzz.c - Fuzzing and differential testing for the Simple Integer Language
+ * ========================================================================
+ * Runs the same programs on every engine and reports any difference in
+ * their output, diagnostics or exit status.  Programs come from a random
+ * generator that follows the grammar at the top of parser.c, or from
+ * libFuzzer.  parser.c is compiled into this file, so the --rows engine
+ * can be driven without a table file.
+ *
+ * Compile : gcc -O2 -pthread -o fuzz fuzz.c
+ * Run     : ./fuzz [options]
+ * Fuzzer  : clang -O1 -g -pthread -fsanitize=fuzzer,address,undefined \
+ *                 -DFUZZ_LIBFUZZER -o fuzz-lf fuzz.c
+ *           ./fuzz-lf [corpus_dir]
+ *
+ * Options :
+ *   --count=N        programs to generate (default 1000)
+ *   --seed=S         seed of the first program; program i uses S + i
+ *                    (default 1)
+ *   --stmts=N        statements per program, at most (default 40);
+ *                    one program in eight instead has PAR_MIN_STMTS to
+ *                    twice that and no faults, and is not run on the
+ *                    rows engine (see PROGRAM GENERATOR)
+ *   --depth=D        nesting depth of expressions, at most (default 4)
+ *   --faults=P       percentage of programs given lexical, syntax or
+ *                    semantic errors (default 20)
+ *   --checked, --no-opt, --threads=N
+ *                    as for ./parser (parallel engine threads: 4)
+ *   --file=PATH      compare the engines on an existing source file
+ *   --emit=PATH      write the program for --seed to PATH and exit
+ *   --save=DIR       write each program the engines disagree on to DIR
+ *   --lex-threads=N  instead, compare lexing inputs of several MB on N
+ *                    threads with lexing them serially (see SPLIT
+ *                    LEXING)
+ *
+ * ENGINES
+ * ---------------------------------------------------------------
+ *   direct    the reference for what a run prints and reports
+ *   ast, vm, jit, parallel
+ *             must match direct exactly when the program has no
+ *             compile errors; otherwise they run nothing, so must
+ *             match ast, and direct must report the same errors
+ *   rows      the vectorised --rows engine, with the first declared
+ *             variable as its input column; each row must match a
+ *             run of the program declaring that variable with the
+ *             row's value (programs without compile errors only)
+ * ---------------------------------------------------------------
+ *
+ * Throughput is source bytes run per second; a row of the rows engine
+ * counts as one run of the program.  The libFuzzer target reads one
+ * byte of options (bit 0 --checked, bit 1 --no-opt, bit 2 run the
+ * generated program the rest of the input hashes to) followed by the
+ * source, and aborts on the first difference between the engines.
+ */
+
+#define PARSER_NO_MAIN
+#ifndef FUZZ_LIBFUZZER
+#define PARSER_BENCH   /* keep read_file() for --file */
+#endif
+#define PARSER_FUZZ    /* keep the --rows engine */
+#include "parser.c"
+
+#include <time.h>
+
+/* ======================== CAPTURED RUNS ======================== */
+
+typedef struct {
+    char  *data;
+    size_t len, cap;
+} Text;
+
+/* What one run printed and reported */
+typedef struct {
+    Text   out;
+    Text   err;
+    size_t row;     /* if non-zero, added to runtime errors as the rows
+                       engine reports them */
+    int    status;
+} Capture;
+
+static void text_put(Text *t, const char *s, size_t n) {
+    if (t->len + n > t->cap) {
+        t->cap  = (t->len + n) * 2;
+        t->data = (char *)xrealloc(t->data, t->cap);
+    }
+    memcpy(t->data + t->len, s, n);
+    t->len += n;
+}
+
+static void text_str(Text *t, const char *s) {
+    text_put(t, s, strlen(s));
+}
+
+static int text_equal(const Text *a, const Text *b) {
+    return a->len == b->len && (a->len == 0 || memcmp(a->data, b->data, a->len) == 0);
+}
+
+static void capture_reset(Capture *c) {
+    c->out.len = 0;
+    c->err.len = 0;
+    c->row     = 0;
+    c->status  = 0;
+}
+
+static void capture_free(Capture *c) {
+    free(c->out.data);
+    free(c->err.data);
+}
+
+static void on_output(void *user, const char *data, size_t len) {
+    text_put(&((Capture *)user)->out, data, len);
+}
+
+/* Diagnostics are kept as the text parser would print */
+static void on_diag(void *user, DiagKind kind, int line, int col, const char *msg) {
+    Capture *c = (Capture *)user;
+    char     tmp[600];
+    if (kind == DIAG_ERROR)
+        snprintf(tmp, sizeof(tmp), "Error: %s", msg);
+    else if (col > 0)
+        snprintf(tmp, sizeof(tmp), "%s [line %d, col %d]: %s", diag_kind_names[kind], line, col, msg);
+    else
+        snprintf(tmp, sizeof(tmp), "%s [line %d]: %s", diag_kind_names[kind], line, msg);
+    text_str(&c->err, tmp);
+    if (kind == DIAG_RUNTIME && c->row > 0) {
+        snprintf(tmp, sizeof(tmp), " in row %zu", c->row);
+        text_str(&c->err, tmp);
+    }
+    text_str(&c->err, "\n");
+}
+
+/* Whether a line of captured diagnostics is a runtime error */
+static int runtime_line(const char *line) {
+    const char *name = diag_kind_names[DIAG_RUNTIME];
+    return strncmp(line, name, strlen(name)) == 0;
+}
+
+/*
+ * The diagnostics of c that every engine reports before running: all
+ * but its runtime errors.
+ */
+static void compile_errors(const Capture *c, Text *t) {
+    t->len = 0;
+    for (size_t i = 0; i < c->err.len;) {
+        const char *line = c->err.data + i;
+        const char *nl   = (const char *)memchr(line, '\n', c->err.len - i);
+        size_t      n    = nl ? (size_t)(nl - line) + 1 : c->err.len - i;
+        if (!runtime_line(line)) text_put(t, line, n);
+        i += n;
+    }
+}
+
+/* Whether c reported nothing but runtime errors */
+static int ran(const Capture *c) {
+    for (size_t i = 0; i < c->err.len;) {
+        const char *line = c->err.data + i;
+        const char *nl   = (const char *)memchr(line, '\n', c->err.len - i);
+        if (!runtime_line(line)) return 0;
+        i = nl ? (size_t)(nl - c->err.data) + 1 : c->err.len;
+    }
+    return 1;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* ======================== ENGINES ======================== */
+/*
+ * Each engine keeps one context for the whole session, so the
+ * differences a reused context could introduce are tested as well.
+ */
+
+enum { E_DIRECT, E_AST, E_VM, E_JIT, E_PARALLEL, E_ROWS, E_COUNT };
+
+typedef struct {
+    const char   *name;
+    Engine        engine;
+    Interp       *in;
+    Capture       run;
+    double        secs;
+    double        bytes;
+    unsigned long runs;
+    unsigned long mismatches;
+} EngineRun;
+
+static EngineRun engines[E_COUNT] = {
+    { "direct",   ENGINE_DIRECT,   NULL, { { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0 }, 0, 0, 0, 0 },
+    { "ast",      ENGINE_AST,      NULL, { { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0 }, 0, 0, 0, 0 },
+    { "vm",       ENGINE_VM,       NULL, { { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0 }, 0, 0, 0, 0 },
+    { "jit",      ENGINE_JIT,      NULL, { { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0 }, 0, 0, 0, 0 },
+    { "parallel", ENGINE_PARALLEL, NULL, { { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0 }, 0, 0, 0, 0 },
+    { "rows",     ENGINE_VM,       NULL, { { NULL, 0, 0 }, { NULL, 0, 0 }, 0, 0 }, 0, 0, 0, 0 },
+};
+
+static Interp       *ref_in;      /* runs each row for the rows engine   */
+static Capture       ref_run, expect_run;
+static unsigned long clean_runs;  /* programs without compile errors     */
+
+static Interp *context(Capture *c, const InterpOptions *opt) {
+    Interp *in = interp_create(opt);
+    interp_set_output(in, on_output, c);
+    interp_set_diagnostics(in, on_diag, c);
+    return in;
+}
+
+/* Create the contexts; opt holds the settings all engines share */
+static void engines_init(const InterpOptions *opt) {
+    for (int e = 0; e < E_COUNT; e++) {
+        InterpOptions o = *opt;
+        o.engine        = engines[e].engine;
+        engines[e].in   = context(&engines[e].run, &o);
+    }
+    InterpOptions o = *opt;
+    o.engine        = ENGINE_AST;
+    ref_in          = context(&ref_run, &o);
+}
+
+static void engines_free(void) {
+    for (int e = 0; e < E_COUNT; e++) {
+        interp_destroy(engines[e].in);
+        capture_free(&engines[e].run);
+    }
+    interp_destroy(ref_in);
+    capture_free(&ref_run);
+    capture_free(&expect_run);
+}
+
+/* Run src on engine e, timing it */
+static void run_engine(int e, const char *src, size_t len) {
+    EngineRun *r = &engines[e];
+    capture_reset(&r->run);
+    double t0 = now_sec();
+    r->run.status = interp_run_string(r->in, src, len);
+    r->secs  += now_sec() - t0;
+    r->bytes += (double)len;
+    r->runs++;
+}
+
+/* ======================== THE ROWS ENGINE ======================== */
+/*
+ * The program's first declaration, `int name = Expr;`, becomes the
+ * input column.  Its Expr must be followed on its line by nothing but
+ * the ";", so that putting a literal (and Expr's newlines) in its place
+ * moves no diagnostic.
+ */
+
+typedef struct {
+    char   name[64];
+    size_t start, end;  /* Expr is src[start, end) */
+} RowsInput;
+
+#define ROWS 24  /* more than one vector's worth (COL_LANES) */
+
+static const Value row_values[ROWS] = {
+    0, 1, -1, 2, -2, 3, 7, -7, 10, 100, -100, 12345, -54321,
+    VALUE_MAX, VALUE_MIN, VALUE_MAX - 1, VALUE_MIN + 1, VALUE_MAX / 2,
+    VALUE_MIN / 2, 46341, -46341, 65536, 1000000, -999999
+};
+
+/* The source text for v */
+static void value_text(Text *t, Value v) {
+    char tmp[64];
+    if (v == VALUE_MIN)
+        snprintf(tmp, sizeof(tmp), "(0 - " VALUE_MAX_TEXT " - 1)");
+    else if (v < 0)
+        snprintf(tmp, sizeof(tmp), "(0 - %lld)", -(long long)v);
+    else
+        snprintf(tmp, sizeof(tmp), "%lld", (long long)v);
+    text_str(t, tmp);
+}
+
+/*
+ * What the rows engine should print and report for src: each row's
+ * values on one line, with an empty field for each print() its errors
+ * left out, and each row's runtime errors naming the row.
+ */
+static void rows_expect(const char *src, size_t len, const RowsInput *ri, int prints,
+                        Capture *want) {
+    Text patched = { NULL, 0, 0 };
+    capture_reset(want);
+    for (size_t row = 0; row < ROWS; row++) {
+        patched.len = 0;
+        text_put(&patched, src, ri->start);
+        value_text(&patched, row_values[row]);
+        for (size_t i = ri->start; i < ri->end; i++)  /* keep the line numbers */
+            if (src[i] == '\n') text_put(&patched, "\n", 1);
+        text_put(&patched, src + ri->end, len - ri->end);
+
+        capture_reset(&ref_run);
+        ref_run.row = row + 1;
+        if (interp_run_string(ref_in, patched.data, patched.len) != 0) want->status = 1;
+        text_put(&want->err, ref_run.err.data, ref_run.err.len);
+
+        /* print() wrote one value per line; the fields after them are
+           the values the row's errors left out */
+        const char *p = ref_run.out.data, *end = p + ref_run.out.len;
+        for (int k = 0; k < prints; k++) {
+            if (k > 0) text_put(&want->out, ",", 1);
+            const char *nl = p < end ? (const char *)memchr(p, '\n', (size_t)(end - p)) : NULL;
+            if (!nl) continue;
+            text_put(&want->out, p, (size_t)(nl - p));
+            p = nl + 1;
+        }
+        if (prints > 0) text_put(&want->out, "\n", 1);
+    }
+    free(patched.data);
+}
+
+/* Run src on the rows engine with the column in ri */
+static void rows_run(const char *src, size_t len, const RowsInput *ri) {
+    EngineRun *r = &engines[E_ROWS];
+    RowTable   t;
+    size_t     padded = (ROWS + COL_LANES - 1) / COL_LANES * COL_LANES;
+    t.count     = 1;
+    t.rows      = ROWS;
+    t.names     = (char **)xmalloc(sizeof(char *));
+    t.values    = (Value **)xmalloc(sizeof(Value *));
+    t.names[0]  = (char *)xmalloc(strlen(ri->name) + 1);
+    t.values[0] = (Value *)xmalloc(padded * sizeof(Value));
+    strcpy(t.names[0], ri->name);
+    memset(t.values[0], 0, padded * sizeof(Value));
+    memcpy(t.values[0], row_values, sizeof(row_values));
+
+    capture_reset(&r->run);
+    double t0 = now_sec();
+    col_source(r->in, src, len, &t);
+    r->secs  += now_sec() - t0;
+    r->bytes += (double)len * ROWS;
+    r->runs  += ROWS;
+    r->run.status = r->in->had_error || r->in->lex_error;
+    free_rows(&t);
+}
+
+/* ======================== COMPARING ======================== */
+
+/* Print the first line in which a and b differ */
+static void show_difference(const char *what, const Text *a, const Text *b) {
+    size_t i = 0, line = 1, start = 0;
+    while (i < a->len && i < b->len && a->data[i] == b->data[i]) {
+        if (a->data[i] == '\n') {
+            line++;
+            start = i + 1;
+        }
+        i++;
+    }
+    const char *ea = (const char *)memchr(a->data + start, '\n', a->len - start);
+    const char *eb = (const char *)memchr(b->data + start, '\n', b->len - start);
+    int na = (int)((ea ? (size_t)(ea - a->data) : a->len) - start);
+    int nb = (int)((eb ? (size_t)(eb - b->data) : b->len) - start);
+    fprintf(stderr, "    %s line %zu: \"%.*s\" instead of \"%.*s\"%s\n", what, line,
+            na > 200 ? 200 : na, a->len > start ? a->data + start : "",
+            nb > 200 ? 200 : nb, b->len > start ? b->data + start : "",
+            start >= a->len ? " (missing)" : "");
+}
+
+/* Report engine e if its run differs from want; returns 1 if it does */
+static int compare(int e, const Capture *got, const Capture *want, const char *label) {
+    int out = text_equal(&got->out, &want->out);
+    int err = text_equal(&got->err, &want->err);
+    if (out && err && got->status == want->status) return 0;
+
+    engines[e].mismatches++;
+    fprintf(stderr, "%s: %s differs\n", label, engines[e].name);
+    if (!out) show_difference("output", &got->out, &want->out);
+    if (!err) show_difference("diagnostics", &got->err, &want->err);
+    if (got->status != want->status)
+        fprintf(stderr, "    status %d instead of %d\n", got->status, want->status);
+    return 1;
+}
+
+/*
+ * Run src on every engine and compare them; ri, if not NULL, is the
+ * rows engine's input column and prints the program's print() count.
+ * Returns the number of engines that differ.
+ */
+static int differential(const char *src, size_t len, const RowsInput *ri, int prints,
+                        const char *label) {
+    for (int e = 0; e < E_ROWS; e++) run_engine(e, src, len);
+
+    int bad = 0;
+    const Capture *direct = &engines[E_DIRECT].run, *ast = &engines[E_AST].run;
+    int clean = ran(ast);
+    clean_runs += clean;
+    if (clean) {
+        for (int e = E_AST; e < E_ROWS; e++) bad += compare(e, &engines[e].run, direct, label);
+    } else {
+        /* direct ran the statements before the first error; the others
+           ran nothing, but every engine found the same errors */
+        Capture want;
+        memset(&want, 0, sizeof(want));
+        compile_errors(direct, &want.err);
+        want.status = direct->status;
+        Capture got = *ast;
+        Text    ast_errors = { NULL, 0, 0 };
+        compile_errors(ast, &ast_errors);
+        got.err = ast_errors;
+        bad += compare(E_AST, &got, &want, label);
+        for (int e = E_VM; e < E_ROWS; e++) bad += compare(e, &engines[e].run, ast, label);
+        capture_free(&want);
+        free(ast_errors.data);
+    }
+
+    if (clean && ri) {
+        rows_expect(src, len, ri, prints, &expect_run);
+        rows_run(src, len, ri);
+        bad += compare(E_ROWS, &engines[E_ROWS].run, &expect_run, label);
+    }
+    return bad;
+}
+
+/* ======================== PROGRAM GENERATOR ======================== */
+/*
+ * Follows the grammar at the top of parser.c:
+ *
+ *   Program     ->  StmtList EOF
+ *   Stmt        ->  Declaration | PrintStmt
+ *   Declaration ->  "int" IDENTIFIER "=" Expr ";"
+ *   PrintStmt   ->  "print" "(" Expr ")" ";"
+ *   Expr        ->  Term  (( "+" | "-" ) Term)*
+ *   Term        ->  Factor (( "*" | "/" ) Factor)*
+ *   Factor      ->  INTEGER | IDENTIFIER | "(" Expr ")"
+ *
+ * Tokens are separated by random whitespace and comments.  Names look
+ * like keywords, and literals run up to the largest value, so the
+ * lexer's edge cases, overflow and division by zero all come up.  A
+ * faulty program also breaks the grammar or the declaration rules
+ * now and then.  Programs of fewer than PAR_MIN_STMTS statements run
+ * serially on the parallel engine, so now and then a large one is
+ * generated instead.
+ */
+
+typedef struct {
+    uint64_t  state;
+    Text     *b;
+    int       depth;     /* --depth */
+    int       faults;    /* inject errors */
+    int       large;     /* PAR_MIN_STMTS statements or more */
+    int       names;     /* declared: name(0) .. name(names - 1) */
+    int       prints;
+    RowsInput input;
+    int       have_input;
+} Gen;
+
+/* xorshift64* */
+static unsigned gen_rand(Gen *g, unsigned n) {
+    g->state ^= g->state >> 12;
+    g->state ^= g->state << 25;
+    g->state ^= g->state >> 27;
+    return (unsigned)((g->state * 0x2545F4914F6CDD1DULL) >> 33) % n;
+}
+
+/* 1 in n */
+static int gen_chance(Gen *g, unsigned n) {
+    return gen_rand(g, n) == 0;
+}
+
+/* The i-th variable's name; some are a keyword with a suffix or a
+   prefix of one */
+static void gen_name(char *buf, size_t size, int i) {
+    static const char *const stems[] = {
+        "v", "x", "in", "int_", "intx", "i", "p", "pr", "print_", "prints", "Int", "PRINT", "_"
+    };
+    snprintf(buf, size, "%s%d", stems[i % 13], i / 13);
+}
+
+/* Whitespace, or a comment, before the next token */
+static void gen_space(Gen *g, int needed) {
+    switch (gen_rand(g, 16)) {
+    case 0:  text_str(g->b, "\n"); break;
+    case 1:  text_str(g->b, "\t"); break;
+    case 2:  text_str(g->b, "  "); break;
+    case 3:  text_str(g->b, " // note\n"); break;
+    case 4:
+    case 5:
+    case 6:  if (!needed) break; /* fall through */
+    default: text_str(g->b, " "); break;
+    }
+}
+
+static void gen_integer(Gen *g) {
+    char tmp[40];
+    switch (gen_rand(g, 12)) {
+    case 0:
+        text_str(g->b, VALUE_MAX_TEXT);
+        return;
+    case 1:
+        snprintf(tmp, sizeof(tmp), "%lld", (long long)(VALUE_MAX / 2 + gen_rand(g, 1000)));
+        break;
+    case 2:
+        snprintf(tmp, sizeof(tmp), "%u", 46340 + gen_rand(g, 3));  /* squares near 2^31 */
+        break;
+    case 3:
+        snprintf(tmp, sizeof(tmp), "%u", gen_rand(g, 100000));
+        break;
+    case 4:
+        text_str(g->b, gen_chance(g, 3) ? "0" : "0000123");
+        return;
+    default:
+        snprintf(tmp, sizeof(tmp), "%u", 1 + gen_rand(g, 9));
+        break;
+    }
+    text_str(g->b, tmp);
+}
+
+static void gen_expr(Gen *g, int depth);
+
+static void gen_factor(Gen *g, int depth) {
+    char     tmp[64];
+    unsigned pick = gen_rand(g, 8);
+    if (depth < g->depth && pick < 2) {
+        text_str(g->b, "(");
+        gen_space(g, 0);
+        gen_expr(g, depth + 1);
+        gen_space(g, 0);
+        text_str(g->b, ")");
+    } else if (g->names > 0 && pick < 6) {
+        /* mostly recent names, so values flow through the program */
+        int window = g->names < 8 ? g->names : 8;
+        int i      = gen_chance(g, 3) ? (int)gen_rand(g, g->names)
+                                      : g->names - 1 - (int)gen_rand(g, window);
+        if (g->faults && gen_chance(g, 40)) i = g->names + (int)gen_rand(g, 3); /* undeclared */
+        gen_name(tmp, sizeof(tmp), i);
+        text_str(g->b, tmp);
+    } else {
+        gen_integer(g);
+        if (g->faults && gen_chance(g, 60)) text_str(g->b, "x");  /* "123x" */
+    }
+}
+
+static void gen_term(Gen *g, int depth) {
+    gen_factor(g, depth);
+    for (int n = (int)gen_rand(g, 3); n > 0; n--) {
+        gen_space(g, 0);
+        text_str(g->b, gen_chance(g, 3) ? "/" : "*");
+        gen_space(g, 0);
+        gen_factor(g, depth);
+    }
+}
+
+static void gen_expr(Gen *g, int depth) {
+    gen_term(g, depth);
+    for (int n = (int)gen_rand(g, 3); n > 0; n--) {
+        gen_space(g, 0);
+        text_str(g->b, gen_chance(g, 2) ? "+" : "-");
+        gen_space(g, 0);
+        gen_term(g, depth);
+    }
+}
+
+/* A token left out or added, for a faulty program */
+static int gen_broken(Gen *g) {
+    if (!g->faults || !gen_chance(g, 30)) return 0;
+    static const char *const junk[] = { "@", ";", "(", ")", "=", "int", "print", "$x", "1 2" };
+    text_str(g->b, junk[gen_rand(g, 9)]);
+    return 1;
+}
+
+static void gen_decl(Gen *g) {
+    char tmp[64];
+    int  i = g->names;
+    if (g->faults && g->names > 0 && gen_chance(g, 30)) i = (int)gen_rand(g, g->names); /* again */
+
+    text_str(g->b, "int ");
+    gen_space(g, 0);
+    gen_name(tmp, sizeof(tmp), i);
+    text_str(g->b, tmp);
+    gen_space(g, 0);
+    text_str(g->b, "=");
+    gen_space(g, 0);
+
+    /* The first declaration is the rows engine's input */
+    int input = !g->have_input;
+    if (input) g->input.start = g->b->len;
+    gen_expr(g, 0);
+    if (input) {
+        g->have_input = 1;
+        g->input.end  = g->b->len;
+        snprintf(g->input.name, sizeof(g->input.name), "%s", tmp);
+        text_str(g->b, ";\n");
+    } else {
+        gen_broken(g);
+        gen_space(g, 0);
+        text_str(g->b, ";");
+    }
+    if (i == g->names) g->names++;
+}
+
+static void gen_print(Gen *g) {
+    text_str(g->b, "print");
+    gen_space(g, 0);
+    text_str(g->b, "(");
+    gen_space(g, 0);
+    gen_expr(g, 0);
+    gen_broken(g);
+    gen_space(g, 0);
+    text_str(g->b, ")");
+    gen_space(g, 0);
+    text_str(g->b, ";");
+    g->prints++;
+}
+
+/* Generate program number seed into b */
+static void generate(Text *b, unsigned seed, int stmts, int depth, int fault_pct, Gen *g) {
+    memset(g, 0, sizeof(*g));
+    g->state  = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)seed * 0xBF58476D1CE4E5B9ULL);
+    g->b      = b;
+    g->depth  = depth;
+    b->len    = 0;
+    gen_rand(g, 1);
+    g->faults = (int)gen_rand(g, 100) < fault_pct;
+
+    /* One program in eight is large enough for the parallel engine to
+       run on its threads rather than serially, and has no faults */
+    int count = 1 + (int)gen_rand(g, (unsigned)stmts);
+    if (gen_chance(g, 8)) {
+        count     = PAR_MIN_STMTS + (int)gen_rand(g, PAR_MIN_STMTS);
+        g->faults = 0;
+        g->large  = 1;
+    }
+    for (int s = 0; s < count; s++) {
+        if (g->names == 0 || gen_rand(g, 3) != 0)
+            gen_decl(g);
+        else
+            gen_print(g);
+        gen_space(g, 0);
+        if (gen_chance(g, 3)) text_str(b, "\n");
+    }
+}
+
+/* ======================== LIBFUZZER TARGET ======================== */
+
+#ifdef FUZZ_LIBFUZZER
+
+/* Change --checked and --no-opt on every context */
+static void engines_set(int checked, int optimise) {
+    Interp *all[E_COUNT + 1];
+    for (int e = 0; e < E_COUNT; e++) all[e] = engines[e].in;
+    all[E_COUNT] = ref_in;
+    for (int k = 0; k < E_COUNT + 1; k++) {
+        all[k]->opt.checked  = checked;
+        all[k]->opt.optimise = optimise;
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static int  ready;
+    static Text b;
+    if (!ready) {
+        InterpOptions opt = { ENGINE_DIRECT, 1, 0, 0, 0, NULL, 0, 2, 0, 0 };
+        engines_init(&opt);
+        atexit(engines_free);
+        ready = 1;
+    }
+    if (size < 1) return 0;
+    engines_set(data[0] & 1, !(data[0] & 2));
+
+    const char *src = (const char *)data + 1;
+    if (!(data[0] & 4)) {
+        if (differential(src, size - 1, NULL, 0, "input") != 0) abort();
+        return 0;
+    }
+
+    /* The input only picks a generated program */
+    Gen g;
+    generate(&b, hash_bytes(src, (int)(size - 1)), 40, 4, 20, &g);
+    if (differential(b.data, b.len, g.have_input ? &g.input : NULL, g.prints, "program") != 0) {
+        fprintf(stderr, "%.*s\n", (int)b.len, b.data);
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+/* ======================== SPLIT LEXING ======================== */
+/*
+ * --lex-threads=N runs inputs big enough for the parallel lexer with
+ * N lexer threads and serially, and compares the two.  Each input is a
+ * long program followed by a short ending, with and without padding
+ * that puts the last chunk boundary past the last ';', where the
+ * threaded lexer has no statement left to start its chunk at.
+ */
+
+static const char *const lex_endings[] = {
+    "print(v1);\n",
+    "print(v1)",
+    "print(v1); // end",
+    "print(v1 @ 2);",
+    "int tail = 1 +",
+    "int tail = 1 + 99999999999;",
+};
+
+#define LEX_ENDINGS ((int)(sizeof(lex_endings) / sizeof(lex_endings[0])))
+
+/* The long program: statements, and comments holding a ';' */
+static void lex_body(Text *b) {
+    char tmp[96];
+    b->len = 0;
+    for (int i = 0; b->len < PLEX_MIN_SIZE + 3 * PLEX_CHUNK; i++) {
+        if (i % 50 == 49)
+            snprintf(tmp, sizeof(tmp), "// a comment; with a semicolon\n");
+        else if (i % 7 == 6)
+            snprintf(tmp, sizeof(tmp), "print(v%d / 3);\n", i - 1);
+        else
+            snprintf(tmp, sizeof(tmp), "int v%d = (%d + %d) * 7;\n", i, i, i % 13);
+        text_str(b, tmp);
+    }
+}
+
+/* Compare one input lexed serially and on threads; returns 1 if they differ */
+static int lex_compare(Interp *serial, Interp *par, Capture *cs, Capture *cp,
+                       const Text *b, const char *label) {
+    capture_reset(cs);
+    capture_reset(cp);
+    cs->status = interp_run_string(serial, b->data, b->len);
+    cp->status = interp_run_string(par, b->data, b->len);
+    if (text_equal(&cs->out, &cp->out) && text_equal(&cs->err, &cp->err) &&
+        cs->status == cp->status)
+        return 0;
+
+    fprintf(stderr, "%s: threaded lexing differs\n", label);
+    if (!text_equal(&cp->out, &cs->out)) show_difference("output", &cp->out, &cs->out);
+    if (!text_equal(&cp->err, &cs->err)) show_difference("diagnostics", &cp->err, &cs->err);
+    if (cp->status != cs->status)
+        fprintf(stderr, "    status %d instead of %d\n", cp->status, cs->status);
+    return 1;
+}
+
+static int lex_split_check(const InterpOptions *opt, int threads) {
+    static const struct { const char *name; Engine engine; int check; } modes[] = {
+        { "direct", ENGINE_DIRECT, 0 }, { "ast", ENGINE_AST, 0 }, { "check", ENGINE_DIRECT, 1 }
+    };
+    Text    body = { NULL, 0, 0 }, b = { NULL, 0, 0 };
+    Capture cs, cp;
+    int     inputs = 0, bad = 0;
+    memset(&cs, 0, sizeof(cs));
+    memset(&cp, 0, sizeof(cp));
+    lex_body(&body);
+
+    for (int m = 0; m < 3; m++) {
+        InterpOptions o = *opt;
+        o.engine        = modes[m].engine;
+        o.check_only    = modes[m].check;
+        o.lex_threads   = 1;
+        Interp *serial  = context(&cs, &o);
+        o.lex_threads   = threads;
+        Interp *par     = context(&cp, &o);
+
+        for (int e = 0; e < LEX_ENDINGS; e++) {
+            for (int pad = 0; pad < 2; pad++) {
+                b.len = 0;
+                text_put(&b, body.data, body.len);
+                if (pad) {
+                    /* a comment line ending just before a chunk boundary */
+                    size_t target = (b.len / PLEX_CHUNK + 1) * PLEX_CHUNK;
+                    if (target - b.len < 4) target += PLEX_CHUNK;
+                    text_str(&b, "//");
+                    while (b.len < target - 2) text_put(&b, "/", 1);
+                    text_str(&b, "\n");
+                }
+                text_str(&b, lex_endings[e]);
+
+                char label[96];
+                snprintf(label, sizeof(label), "%s, ending %d%s", modes[m].name, e + 1,
+                         pad ? " after a chunk boundary" : "");
+                bad += lex_compare(serial, par, &cs, &cp, &b, label);
+                inputs++;
+            }
+        }
+        interp_destroy(serial);
+        interp_destroy(par);
+    }
+
+    printf("lexing on %d threads: %d inputs, %d differ from serial lexing\n", threads, inputs, bad);
+    capture_free(&cs);
+    capture_free(&cp);
+    free(body.data);
+    free(b.data);
+    return bad != 0;
+}
+
+/* ======================== MAIN ======================== */
+
+static int save_program(const char *dir, unsigned seed, const Text *b) {
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/fuzz-%u.sil", dir, seed);
+    FILE *fp = fopen(path, "w");
+    if (!fp || fwrite(b->data, 1, b->len, fp) != b->len || fclose(fp) != 0) {
+        fprintf(stderr, "Error: cannot write '%s'\n", path);
+        return -1;
+    }
+    fprintf(stderr, "    saved as %s\n", path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    InterpOptions opt    = { ENGINE_DIRECT, 1, 0, 0, 0, NULL, 0, 4, 0, 0 };
+    int           count  = 1000;
+    int           stmts  = 40;
+    int           depth  = 4;
+    int           faults = 20;
+    unsigned      seed   = 1;
+    const char   *file   = NULL;
+    const char   *emit   = NULL;
+    const char   *save   = NULL;
+    int           lex    = 0;
+
+    /* --- Check command-line arguments --- */
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--count=", 8) == 0) {
+            count = atoi(arg + 8);
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            seed = (unsigned)strtoul(arg + 7, NULL, 10);
+        } else if (strncmp(arg, "--stmts=", 8) == 0) {
+            stmts = atoi(arg + 8);
+        } else if (strncmp(arg, "--depth=", 8) == 0) {
+            depth = atoi(arg + 8);
+        } else if (strncmp(arg, "--faults=", 9) == 0) {
+            faults = atoi(arg + 9);
+        } else if (strcmp(arg, "--checked") == 0) {
+            opt.checked = 1;
+        } else if (strcmp(arg, "--no-opt") == 0) {
+            opt.optimise = 0;
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            opt.exec_threads = atoi(arg + 10);
+        } else if (strncmp(arg, "--file=", 7) == 0) {
+            file = arg + 7;
+        } else if (strncmp(arg, "--emit=", 7) == 0) {
+            emit = arg + 7;
+        } else if (strncmp(arg, "--save=", 7) == 0) {
+            save = arg + 7;
+        } else if (strncmp(arg, "--lex-threads=", 14) == 0) {
+            lex = atoi(arg + 14);
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'\n", arg);
+            return 1;
+        }
+    }
+    if (count < 1 || stmts < 1 || depth < 0 || depth > 20 || faults < 0 || faults > 100 ||
+        lex < 0 || lex == 1) {
+        fprintf(stderr, "Error: --count, --stmts, --depth (0-20), --faults (0-100) or "
+                        "--lex-threads (2 or more) out of range\n");
+        return 1;
+    }
+    if (lex) return lex_split_check(&opt, lex);
+
+    Text b = { NULL, 0, 0 };
+    Gen  g;
+    if (emit) {
+        generate(&b, seed, stmts, depth, faults, &g);
+        FILE *fp = fopen(emit, "w");
+        if (!fp || fwrite(b.data, 1, b.len, fp) != b.len || fclose(fp) != 0) {
+            fprintf(stderr, "Error: cannot write '%s'\n", emit);
+            return 1;
+        }
+        free(b.data);
+        return 0;
+    }
+
+    engines_init(&opt);
+    int bad = 0;
+
+    if (file) {
+        /* --- One existing file, on every engine but rows --- */
+        Interp    *in = interp_create(NULL);
+        SourceFile source;
+        if (read_file(in, file, &source) != 0) return 1;
+        bad = differential(source.data, source.length, NULL, 0, file) != 0;
+        close_source(&source);
+        interp_destroy(in);
+        count = 1;
+    } else {
+        /* --- Generated programs --- */
+        for (int i = 0; i < count; i++) {
+            unsigned s = seed + (unsigned)i;
+            char     label[64];
+            snprintf(label, sizeof(label), "program --seed=%u", s);
+            generate(&b, s, stmts, depth, faults, &g);
+            /* A large program is there for the parallel engine; the rows
+               engine would rerun it for every row */
+            const RowsInput *ri = g.have_input && !g.large ? &g.input : NULL;
+            if (differential(b.data, b.len, ri, g.prints, label) != 0) {
+                bad++;
+                if (save) save_program(save, s, &b);
+            }
+        }
+    }
+
+    /* --- Report --- */
+    printf("%d program%s, %s%s; %lu without compile errors, %d with differences\n", count,
+           count == 1 ? "" : "s", opt.optimise ? "optimised" : "no-opt",
+           opt.checked ? ", checked" : "", clean_runs, bad);
+    printf("%-10s %10s %10s %10s %12s %10s\n", "engine", "runs", "ms", "MB/s", "runs/s", "differ");
+    for (int e = 0; e < E_COUNT; e++) {
+        const EngineRun *r = &engines[e];
+        if (r->runs == 0) continue;
+        double secs = r->secs > 0 ? r->secs : 1e-9;
+        printf("%-10s %10lu %10.1f %10.1f %12.0f %10lu\n", r->name, r->runs, r->secs * 1e3,
+               r->bytes / (1024.0 * 1024.0) / secs, r->runs / secs, r->mismatches);
+    }
+
+    free(b.data);
+    engines_free();
+    return bad != 0;
+}
+
+#endif /* FUZZ_LIBFUZZER */
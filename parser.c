@@ -5,8 +5,88 @@
  * Context-Free Grammar, detects syntax/semantic errors, executes
  * arithmetic operations, and displays results via print().
  *
- * Compile : gcc -o parser parser.c
- * Run     : ./parser inputfile
+ * Compile : gcc -O2 -pthread -o parser parser.c
+ * Run     : ./parser [options] inputfile       ("-" reads stdin)
+ *           ./parser [options] --jobs N file... | directory
+ *           ./parser [--no-opt] [--checked] --compile inputfile -o out.silc
+ *           ./parser [options] --rows=FILE [--binary-input] inputfile
+ *           ./parser [options] --serve[=PATH]
+ * Library : gcc -O2 -pthread -DPARSER_NO_MAIN -c parser.c
+ *           (embedding API in parser.h)
+ * Bench   : gcc -O2 -pthread -o bench bench.c   (see bench.c)
+ * Fuzz    : gcc -O2 -pthread -o fuzz fuzz.c     (see fuzz.c)
+ * Values  : 32-bit by default; build with -DSIL_INT64 for 64-bit values
+ * Profile : -DSIL_STATS enables --stats and --trace (off by default, so
+ *           normal builds carry no counters)
+ * Tuning  : -mavx2 widens the vector lexer and --rows to 32 bytes;
+ *           -DLEX_SIMD=0 and -DVM_COMPUTED_GOTO=0 select the portable
+ *           code paths
+ *
+ * Options :
+ *   --engine=direct  execute each statement as soon as it is parsed,
+ *                    in constant memory (default)
+ *   --engine=ast     parse the whole program into an AST first, then
+ *                    run it; nothing runs if there are compile errors
+ *   --engine=vm      like ast, but compile the AST to bytecode and run
+ *                    it on a stack virtual machine
+ *   --engine=parallel
+ *                    like ast, but statements whose variables are
+ *                    already computed run concurrently on a work-
+ *                    stealing pool; output and errors stay in order
+ *   --jit            like vm, but translate the bytecode to native
+ *                    x86-64 or AArch64 code first (same as
+ *                    --engine=jit); falls back to the VM elsewhere
+ *   --no-opt         skip constant folding and common-subexpression
+ *                    elimination in the ast, parallel and vm engines
+ *   --checked        report integer overflow as a Runtime Error at the
+ *                    operator instead of wrapping around
+ *   --compile -o OUT compile the source file to a .silc file at OUT
+ *                    (honours --no-opt and --checked); running OUT as
+ *                    an input then skips lexing, parsing and compiling
+ *                    (see PRECOMPILED PROGRAMS)
+ *   --check          only lex, parse and check the program (undeclared
+ *                    and redeclared variables, division by a constant
+ *                    zero); nothing is evaluated or printed.  A .silc
+ *                    file is only verified
+ *   --rows=FILE      run the program once for every row of FILE, a
+ *                    table of values for the variables named in its
+ *                    header, over whole columns at a time, and write
+ *                    one line of print() values per row (see
+ *                    COLUMNAR EXECUTION)
+ *   --binary-input   the --rows file holds raw native-endian columns
+ *                    after its header line
+ *   --serve[=PATH]   run as a server: answer requests of statements,
+ *                    one per line, against variables that persist
+ *                    across requests; on stdin and stdout, or on each
+ *                    connection to a Unix socket at PATH (see SERVER
+ *                    MODE).  Requests always run on the direct engine;
+ *                    --check cannot be combined with it
+ *   --binary-output  write print() results as raw native-endian values
+ *                    (int32, or int64 in SIL_INT64 builds) instead of
+ *                    decimal lines
+ *   --cache[=DIR]    with the vm and jit engines, reuse bytecode saved in
+ *                    DIR (default .sil.cache) by an earlier run of the
+ *                    same source, and save it there after compiling
+ *   --jobs N         batch mode: run every given file (or every file in
+ *                    a given directory) on N threads; each file's output
+ *                    and diagnostics are kept together and in order
+ *   --lex-threads=N  tokenise inputs of 4 MB or more on N threads ahead
+ *                    of the parser (default: one per CPU, up to 8;
+ *                    0 or 1 lexes serially)
+ *   --threads=N      threads for --engine=parallel (default: one per
+ *                    CPU, up to 8)
+ *   --max-errors N   stop parsing a file once N diagnostics have been
+ *                    reported for it
+ *   --diagnostics=json
+ *                    write diagnostics as JSON lines with the file,
+ *                    line, col, kind and message (see DIAGNOSTIC OUTPUT)
+ *   --stats          after each file, report the time and allocations
+ *                    of every phase plus token, symbol-probe, nesting
+ *                    and print counts (SIL_STATS builds only)
+ *   --trace=chrome[:FILE]
+ *                    write every phase of every file to FILE (default
+ *                    trace.json) as Chrome trace events (SIL_STATS
+ *                    builds only)
  *
  * ---------------------------------------------------------------
  * CONTEXT-FREE GRAMMAR (CFG)
@@ -29,7 +109,7 @@
  * ---------------------------------------------------------------
  *   Keywords    : int, print
  *   Identifiers : [a-zA-Z_][a-zA-Z0-9_]*
- *   Integers    : [0-9]+
+ *   Integers    : [0-9]+  (at most 2^31 - 1, or 2^63 - 1 with SIL_INT64)
  *   Operators   : +  -  *  /  =
  *   Punctuation : (  )  ;
  * ---------------------------------------------------------------
@@ -38,7 +118,110 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#define HAVE_PTHREADS 1
+#else
+#define HAVE_PTHREADS 0
+#endif
+
+/* Per-phase profiling (--stats, --trace); off unless built with -DSIL_STATS */
+#ifndef SIL_STATS
+#define SIL_STATS 0
+#endif
+#if SIL_STATS
+#include <time.h>
+#endif
+
+/* Vector lexing; build with -DLEX_SIMD=0 for the scalar scanner only */
+#ifndef LEX_SIMD
+#define LEX_SIMD 1
+#endif
+#if LEX_SIMD && defined(__AVX2__)
+#include <immintrin.h>
+#elif LEX_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#elif LEX_SIMD && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "parser.h"
+
+/* ======================== MEMORY HELPERS ======================== */
+
+#if SIL_STATS
+/* Allocations made by the current thread (see STATISTICS) */
+static _Thread_local unsigned long stat_allocs, stat_alloc_bytes;
+#define STAT_ALLOC(size) (stat_allocs++, stat_alloc_bytes += (size))
+#else
+#define STAT_ALLOC(size) ((void)0)
+#endif
+
+/* malloc()/realloc() that report and exit instead of returning NULL */
+static void *xmalloc(size_t size) {
+    STAT_ALLOC(size);
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void *xrealloc(void *ptr, size_t size) {
+    STAT_ALLOC(size);
+    void *p = realloc(ptr, size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* Make room for need elements in a growable array of size-byte items */
+static void *stack_reserve(void *items, int *cap, int need, size_t size) {
+    if (need <= *cap) return items;
+    while (*cap < need) *cap = *cap ? *cap * 2 : 64;
+    return xrealloc(items, (size_t)*cap * size);
+}
+
+/* ======================== INTEGER VALUES ======================== */
+/*
+ * Every variable, literal and intermediate result is a Value: a 32-bit
+ * int by default, or a 64-bit integer when built with -DSIL_INT64.  The
+ * choice is made at compile time so the default build pays nothing for
+ * it.  UValue is the matching unsigned type used for wrapping arithmetic.
+ */
+
+#ifdef SIL_INT64
+typedef int64_t  Value;
+typedef uint64_t UValue;
+#define VALUE_MIN      INT64_MIN
+#define VALUE_MAX      INT64_MAX
+#define VALUE_MAX_TEXT "9223372036854775807"
+#else
+typedef int      Value;
+typedef unsigned UValue;
+#define VALUE_MIN      INT_MIN
+#define VALUE_MAX      INT_MAX
+#define VALUE_MAX_TEXT "2147483647"
+#endif
 
 /* ======================== TOKEN DEFINITIONS ======================== */
 
@@ -89,508 +272,5691 @@ static const char *token_type_name(TokenType t) {
     return "?";
 }
 
-/* A single token produced by the tokeniser */
+/*
+ * A single token produced by the tokeniser.  The lexeme is not copied:
+ * it is the slice [offset, offset + length) of the source buffer.
+ */
 typedef struct {
     TokenType type;
-    char      text[256]; /* lexeme text                  */
-    int       int_value; /* numeric value (for integers) */
-    int       line;      /* source line number            */
-    int       col;       /* source column number          */
+    size_t    offset;    /* start of the lexeme in the source        */
+    int       length;    /* lexeme length in bytes                   */
+    Value     value;     /* integer value, or interned identifier id */
+    int       line;      /* source line number                       */
+    int       col;       /* source column number                     */
 } Token;
 
-/* ======================== TOKENISER (LEXER) ======================== */
+/* ======================== ARENA ALLOCATOR ======================== */
+/*
+ * AST nodes are bump-allocated from large blocks rather than malloc'd
+ * one by one.  Resetting an arena rewinds every block for reuse, and
+ * freeing it releases the whole program in one go.
+ */
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t             used;
+    size_t             size;
+    /* the block's storage follows the header */
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *first; /* chain of blocks, oldest first      */
+    ArenaBlock *cur;   /* block currently being allocated in */
+} Arena;
+
+/* Allocate size bytes (pointer-aligned) from the arena */
+static void *arena_alloc(Arena *a, size_t size) {
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    while (!a->cur || a->cur->used + size > a->cur->size) {
+        if (a->cur && a->cur->next) {
+            /* reuse a block left over from before a reset */
+            a->cur = a->cur->next;
+            a->cur->used = 0;
+            continue;
+        }
+        size_t want = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        ArenaBlock *b = (ArenaBlock *)xmalloc(sizeof(ArenaBlock) + want);
+        b->next = NULL;
+        b->used = 0;
+        b->size = want;
+        if (a->cur) a->cur->next = b; else a->first = b;
+        a->cur = b;
+    }
+
+    void *p = (char *)(a->cur + 1) + a->cur->used;
+    a->cur->used += size;
+    return p;
+}
 
-#define MAX_TOKENS 4096
+/* Discard everything allocated, keeping the blocks for reuse */
+static void arena_reset(Arena *a) {
+    a->cur = a->first;
+    if (a->cur) a->cur->used = 0;
+}
 
-static Token tokens[MAX_TOKENS];
-static int   token_count = 0;
+/* Release all of the arena's blocks */
+static void arena_free(Arena *a) {
+    ArenaBlock *b = a->first;
+    while (b) {
+        ArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->first = a->cur = NULL;
+}
 
+/* ======================== INTERPRETER CONTEXT ======================== */
 /*
- * tokenise() - Scans the entire source string and fills the tokens[] array.
- * Returns 0 on success, -1 on a lexical error.
+ * Everything one run of the interpreter reads or writes lives in an
+ * Interp, so independent programs can run side by side (see the batch
+ * mode in main()).  The fields are grouped by the phase that owns them
+ * and are described in the corresponding sections below.
  */
-static int tokenise(const char *src) {
-    int i = 0;
-    int line = 1;
-    int col  = 1;
 
-    token_count = 0;
+#define LOOKAHEAD    4           /* lookahead ring size (a power of two) */
+#define OUT_BUF_SIZE (64 * 1024) /* print() output buffer                */
 
-    while (src[i] != '\0') {
+typedef struct InternEntry InternEntry;
+typedef struct Variable    Variable;
+typedef struct ProgCache   ProgCache;
+typedef struct ParLexer    ParLexer;
+typedef struct Retained    Retained;
+typedef struct Cse         Cse;
+typedef struct Bytecode    Bytecode;
+typedef struct JitCode     JitCode;
 
-        /* ---------- skip whitespace ---------- */
-        if (src[i] == ' ' || src[i] == '\t' || src[i] == '\r') {
-            col++;
-            i++;
-            continue;
-        }
-        if (src[i] == '\n') {
-            line++;
-            col = 1;
-            i++;
-            continue;
-        }
+static void cache_free(ProgCache *c);
+static void retained_free(Retained *r);
+static void cse_free(Cse *c);
+static void bytecode_free(Bytecode *bc);
+static void jit_free(JitCode *jc);
 
-        /* ---------- skip single-line comments // ---------- */
-        if (src[i] == '/' && src[i + 1] == '/') {
-            while (src[i] != '\0' && src[i] != '\n') { i++; }
-            continue;
-        }
+/* A growable list of AST nodes (see nodes_postorder()) */
+typedef struct {
+    struct Node **items;
+    int           count, cap;
+} NodeList;
 
-        /* ---------- identifiers & keywords ---------- */
-        if (isalpha((unsigned char)src[i]) || src[i] == '_') {
-            int start = i;
-            int start_col = col;
-            while (isalnum((unsigned char)src[i]) || src[i] == '_') {
-                i++;
-                col++;
-            }
-            int len = i - start;
-            if (len >= 255) len = 255;
-
-            Token tok;
-            memset(&tok, 0, sizeof(tok));
-            strncpy(tok.text, &src[start], len);
-            tok.text[len] = '\0';
-            tok.line = line;
-            tok.col  = start_col;
-
-            /* Check for keywords */
-            if (strcmp(tok.text, "int") == 0) {
-                tok.type = TOK_INT;
-            } else if (strcmp(tok.text, "print") == 0) {
-                tok.type = TOK_PRINT;
-            } else {
-                tok.type = TOK_IDENTIFIER;
-            }
+#if SIL_STATS
+/* Phases timed by --stats (see STATISTICS) */
+enum {
+    PHASE_READ, PHASE_PARSE, PHASE_DIRECT, PHASE_OPTIMISE, PHASE_COMPILE,
+    PHASE_EXECUTE, PHASE_COUNT
+};
 
-            if (token_count >= MAX_TOKENS) {
-                fprintf(stderr, "Error: too many tokens (max %d)\n", MAX_TOKENS);
-                return -1;
-            }
-            tokens[token_count++] = tok;
-            continue;
-        }
+typedef struct {
+    const char   *file;                     /* name for reports       */
+    int           ran[PHASE_COUNT];
+    double        secs[PHASE_COUNT];
+    unsigned long allocs[PHASE_COUNT];
+    unsigned long alloc_bytes[PHASE_COUNT];
+    double        start;                    /* of the current phase   */
+    unsigned long allocs0, bytes0;
+    unsigned long tokens, sym_probes, prints;
+    int           depth, max_depth;         /* expression nesting     */
+} RunStats;
+#endif
 
-        /* ---------- integer literals ---------- */
-        if (isdigit((unsigned char)src[i])) {
-            int start = i;
-            int start_col = col;
-            while (isdigit((unsigned char)src[i])) {
-                i++;
-                col++;
-            }
-            /* Check that the integer is not immediately followed by a letter
-               (e.g., "123abc" is not valid) */
-            if (isalpha((unsigned char)src[i]) || src[i] == '_') {
-                fprintf(stderr,
-                    "Lexical Error [line %d, col %d]: invalid token '%c' after integer literal\n",
-                    line, start_col, src[i]);
-                return -1;
-            }
+struct Interp {
+    InterpOptions opt;
 
-            int len = i - start;
-            if (len >= 255) len = 255;
+    /* identifier interning */
+    InternEntry *intern_ids;    /* indexed by id               */
+    int          intern_count;
+    int          intern_cap;
+    int         *intern_table;  /* hash slots: id, or -1       */
+    unsigned     intern_mask;   /* table size - 1 (power of 2) */
+    char        *intern_pool;   /* NUL-terminated names        */
+    size_t       pool_len;
+    size_t       pool_cap;
 
-            Token tok;
-            memset(&tok, 0, sizeof(tok));
-            strncpy(tok.text, &src[start], len);
-            tok.text[len] = '\0';
-            tok.type      = TOK_INTEGER;
-            tok.int_value = atoi(tok.text);
-            tok.line      = line;
-            tok.col       = start_col;
+    /* lexer */
+    const char  *lex_src;       /* source being scanned               */
+    size_t       lex_len;       /* its length; it need not end in \0  */
+    size_t       lex_pos;       /* index of the next unread char      */
+    int          lex_line;      /* line of lex_src[lex_pos]           */
+    int          lex_col;       /* column of lex_src[lex_pos]         */
+    int          lex_error;     /* set once a lexical error is seen   */
+    int          lex_defer;     /* hash identifiers, don't intern them */
+    ParLexer    *plex;          /* parallel lexer, while it is running */
 
-            if (token_count >= MAX_TOKENS) {
-                fprintf(stderr, "Error: too many tokens (max %d)\n", MAX_TOKENS);
-                return -1;
-            }
-            tokens[token_count++] = tok;
-            continue;
-        }
+    /* parser */
+    Token        ring[LOOKAHEAD];
+    int          ring_head;     /* ring index of the current token */
+    int          ring_count;    /* tokens buffered from ring_head  */
+    int          had_error;     /* set to 1 on first error         */
+    int          panic;         /* skipping a statement with a syntax error */
+    int          session;       /* --serve: symbols persist across runs */
+    Arena        ast_arena;     /* Nodes and Stmts of the current parse */
+    struct ExprOp *expr_ops;    /* expression parser's operator stack */
+    int          expr_nops, expr_ops_cap;
+    struct Node **expr_nodes;   /* ... and its operand stack          */
+    int          expr_nnodes, expr_nodes_cap;
+    struct EvalFrame *eval_frames; /* eval_expr()'s walk stack  */
+    int          eval_frames_cap;
+    Value       *eval_values;   /* ... and its value stack       */
+    int          eval_values_cap;
 
-        /* ---------- single-character tokens ---------- */
-        {
-            Token tok;
-            memset(&tok, 0, sizeof(tok));
-            tok.text[0] = src[i];
-            tok.text[1] = '\0';
-            tok.line     = line;
-            tok.col      = col;
-
-            switch (src[i]) {
-                case '=': tok.type = TOK_ASSIGN;    break;
-                case '+': tok.type = TOK_PLUS;      break;
-                case '-': tok.type = TOK_MINUS;     break;
-                case '*': tok.type = TOK_STAR;      break;
-                case '/': tok.type = TOK_SLASH;     break;
-                case '(': tok.type = TOK_LPAREN;    break;
-                case ')': tok.type = TOK_RPAREN;    break;
-                case ';': tok.type = TOK_SEMICOLON; break;
-                default:
-                    fprintf(stderr,
-                        "Lexical Error [line %d, col %d]: unexpected character '%c'\n",
-                        line, col, src[i]);
-                    return -1;
-            }
+    /* symbol table and variable values */
+    Variable    *sym_table;
+    unsigned     sym_mask;      /* table size - 1 (power of 2) */
+    int          sym_count;     /* also the next free slot     */
+    Value       *slot_values;   /* variable values, by slot    */
+    int          slot_cap;
 
-            if (token_count >= MAX_TOKENS) {
-                fprintf(stderr, "Error: too many tokens (max %d)\n", MAX_TOKENS);
-                return -1;
-            }
-            tokens[token_count++] = tok;
-            i++;
-            col++;
-        }
-    }
+    /*
+     * Working storage of the passes after parsing.  Like every buffer
+     * above, it is kept from one run to the next and only ever grows,
+     * so running a program again allocates nothing.
+     */
+    NodeList     walk;          /* a tree's nodes in evaluation order  */
+    NodeList     walk_tmp;      /* ... and the stack that builds it    */
+    Cse         *cse;           /* optimiser tables, made on first use */
+    Bytecode    *code;          /* vm and jit programs, ditto          */
+    JitCode     *jit;           /* native code of the jit, ditto       */
+    Value       *vm_stack;      /* operand stack of the vm and jit     */
+    int          vm_stack_cap;
+    char        *read_buf;      /* read_file()'s buffer for input it   */
+    size_t       read_cap;      /* cannot map (see FILE READING)       */
 
-    /* Append EOF token */
-    {
-        Token eof;
-        memset(&eof, 0, sizeof(eof));
-        eof.type = TOK_EOF;
-        strcpy(eof.text, "EOF");
-        eof.line = line;
-        eof.col  = col;
-        tokens[token_count++] = eof;
-    }
+    /* compiled-program cache, created on first use */
+    ProgCache   *cache;
 
-    return 0;
+    /* program kept for incremental re-runs, if any */
+    Retained    *retained;
+
+#if SIL_STATS
+    RunStats     stats;
+#endif
+
+    /* output; a callback, when set, takes the place of its stream */
+    FILE          *out_fp;      /* where print() output goes   */
+    FILE          *err_fp;      /* where diagnostics go        */
+    InterpOutputFn out_fn;
+    void          *out_user;
+    InterpDiagFn   diag_fn;
+    void          *diag_user;
+    int            diag_count;  /* diagnostics reported this run */
+    size_t         out_len;
+    char           out_buf[OUT_BUF_SIZE];
+};
+
+/* Set up an empty context writing to out and err */
+static void interp_init(Interp *in, FILE *out, FILE *err) {
+    memset(in, 0, offsetof(Interp, out_buf));
+    in->opt.engine   = ENGINE_DIRECT;
+    in->opt.optimise = 1;
+    in->out_fp = out;
+    in->err_fp = err;
+}
+
+/* Release everything a context owns (but not the Interp itself) */
+static void interp_release(Interp *in) {
+    free(in->intern_ids);
+    free(in->intern_table);
+    free(in->intern_pool);
+    free(in->sym_table);
+    free(in->slot_values);
+    cache_free(in->cache);
+    retained_free(in->retained);
+    arena_free(&in->ast_arena);
+    free(in->expr_ops);
+    free(in->expr_nodes);
+    free(in->eval_frames);
+    free(in->eval_values);
+    free(in->walk.items);
+    free(in->walk_tmp.items);
+    cse_free(in->cse);
+    if (in->code) bytecode_free(in->code);
+    free(in->code);
+    jit_free(in->jit);
+    free(in->vm_stack);
+    free(in->read_buf);
 }
 
-/* ======================== SYMBOL TABLE ======================== */
 /*
- * A simple variable store: maps identifier names to integer values.
- * Used for semantic checking (undeclared / redeclared variables)
- * and for execution (storing and retrieving values).
+ * diag() - Report one diagnostic:
+ *     "<Kind> Error [line L, col C]: <message>"
+ * col = 0 leaves out the column, and DIAG_ERROR prints "Error: ...".
+ * With max_errors set, the diagnostic that reaches the limit is
+ * followed by a note that the run stops there, and later ones are
+ * dropped; the parser checks errors_exhausted() to stop early.
  */
+static void diag(Interp *in, DiagKind kind, int line, int col, const char *fmt, ...)
+    __attribute__((format(printf, 5, 6)));
 
-#define MAX_VARS 256
+/* The text form's name for each DiagKind */
+static const char *const diag_kind_names[DIAG_RUNTIME + 1] = {
+    "Error", "Lexical Error", "Syntax Error", "Semantic Error", "Runtime Error"
+};
 
-typedef struct {
-    char name[256];
-    int  value;
-    int  declared; /* 1 = yes */
-} Variable;
+/* Write a diagnostic as text */
+static void diag_write(FILE *fp, DiagKind kind, int line, int col, const char *msg) {
+    if (kind == DIAG_ERROR)
+        fprintf(fp, "Error: %s\n", msg);
+    else if (col > 0)
+        fprintf(fp, "%s [line %d, col %d]: %s\n", diag_kind_names[kind], line, col, msg);
+    else
+        fprintf(fp, "%s [line %d]: %s\n", diag_kind_names[kind], line, msg);
+}
 
-static Variable sym_table[MAX_VARS];
-static int      sym_count = 0;
+static void diag_emit(Interp *in, DiagKind kind, int line, int col, const char *msg) {
+    if (in->diag_fn)
+        in->diag_fn(in->diag_user, kind, line, col, msg);
+    else
+        diag_write(in->err_fp, kind, line, col, msg);
+}
 
-/* Look up a variable; returns pointer or NULL */
-static Variable *sym_lookup(const char *name) {
-    for (int i = 0; i < sym_count; i++) {
-        if (strcmp(sym_table[i].name, name) == 0)
-            return &sym_table[i];
-    }
-    return NULL;
+static int errors_exhausted(const Interp *in) {
+    return in->opt.max_errors > 0 && in->diag_count >= in->opt.max_errors;
 }
 
-/* Declare a new variable; returns pointer or NULL on redeclaration */
-static Variable *sym_declare(const char *name, int line) {
-    if (sym_lookup(name)) {
-        fprintf(stderr,
-            "Semantic Error [line %d]: variable '%s' is already declared\n",
-            line, name);
-        return NULL;
-    }
-    if (sym_count >= MAX_VARS) {
-        fprintf(stderr, "Error: too many variables (max %d)\n", MAX_VARS);
-        return NULL;
+static void diag(Interp *in, DiagKind kind, int line, int col, const char *fmt, ...) {
+    char    msg[512];
+    va_list ap;
+
+    if (errors_exhausted(in)) return;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    in->diag_count++;
+    diag_emit(in, kind, line, col, msg);
+    if (errors_exhausted(in)) {
+        snprintf(msg, sizeof(msg), "too many errors; stopping after %d", in->diag_count);
+        diag_emit(in, DIAG_ERROR, 0, 0, msg);
     }
-    Variable *v = &sym_table[sym_count++];
-    strncpy(v->name, name, 255);
-    v->name[255] = '\0';
-    v->declared = 1;
-    v->value    = 0;
-    return v;
 }
 
-/* ============= RECURSIVE-DESCENT PARSER + INTERPRETER ============= */
+/* ======================== STATISTICS ======================== */
 /*
- * The parser is a recursive-descent parser that directly evaluates
- * expressions as it parses (interpreter mode).  It follows the CFG
- * exactly.
+ * Built with -DSIL_STATS, each run records the wall time and the
+ * allocations (xmalloc/xrealloc calls on the running thread) of every
+ * phase.  It also counts tokens, symbol-table probes, print() values
+ * written and the deepest expression nesting.  --stats prints these
+ * after each file, and --trace=chrome also writes every phase as a
+ * Chrome trace event (load the file in chrome://tracing or Perfetto).
+ * The lexer runs inside the parser, so its time is part of "parse".
  *
- * A global `pos` index walks through the tokens[] array.
- * A global `had_error` flag is set on the first error; once set,
- * parsing continues to report as many errors as practical, but
- * execution results are suppressed.
+ * Without SIL_STATS the STAT_* macros expand to nothing, and the
+ * counters and hooks compile out entirely.
  */
 
-static int pos       = 0;   /* current position in tokens[] */
-static int had_error = 0;   /* set to 1 on first error      */
+#if SIL_STATS
 
-/* Return the current token without consuming it */
-static Token *current_token(void) {
-    return &tokens[pos];
+/* Process-wide trace switch, set by main() */
+static const char *trace_path;     /* --trace=chrome[:FILE], or NULL  */
+
+/* Trace events from every thread, written out by trace_write() */
+typedef struct {
+    int    phase;
+    int    tid;
+    double ts, dur;   /* microseconds since trace_epoch */
+    char  *file;
+} TraceEvent;
+
+static struct {
+    TraceEvent     *events;
+    int             count, cap;
+    double          epoch;
+    int             next_tid;
+#if HAVE_PTHREADS
+    pthread_mutex_t lock;
+#endif
+} trace_log = {
+    NULL, 0, 0, 0, 0,
+#if HAVE_PTHREADS
+    PTHREAD_MUTEX_INITIALIZER
+#endif
+};
+
+static _Thread_local int trace_tid;   /* 0 until the thread's first event */
+
+static double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
 }
 
-/* Consume the current token and advance */
-static Token *advance(void) {
-    Token *t = &tokens[pos];
-    if (t->type != TOK_EOF) pos++;
-    return t;
+static void stats_begin(Interp *in) {
+    in->stats.allocs0 = stat_allocs;
+    in->stats.bytes0  = stat_alloc_bytes;
+    in->stats.start   = stats_now();
 }
 
-/* Check if the current token matches a given type */
-static int check(TokenType type) {
-    return current_token()->type == type;
+static void stats_end(Interp *in, int phase) {
+    RunStats *s   = &in->stats;
+    double    end = stats_now();
+
+    s->ran[phase]          = 1;
+    s->secs[phase]        += end - s->start;
+    s->allocs[phase]      += stat_allocs - s->allocs0;
+    s->alloc_bytes[phase] += stat_alloc_bytes - s->bytes0;
+    if (!trace_path) return;
+
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&trace_log.lock);
+#endif
+    if (!trace_tid) trace_tid = ++trace_log.next_tid;
+    if (trace_log.count == trace_log.cap) {
+        trace_log.cap    = trace_log.cap ? trace_log.cap * 2 : 256;
+        trace_log.events = (TraceEvent *)xrealloc(trace_log.events,
+                                                  trace_log.cap * sizeof(TraceEvent));
+    }
+    TraceEvent *e = &trace_log.events[trace_log.count++];
+    const char *file = s->file ? s->file : "";
+    e->phase = phase;
+    e->tid   = trace_tid;
+    e->ts    = (s->start - trace_log.epoch) * 1e6;
+    e->dur   = (end - s->start) * 1e6;
+    e->file  = (char *)xmalloc(strlen(file) + 1);
+    strcpy(e->file, file);
+#if HAVE_PTHREADS
+    pthread_mutex_unlock(&trace_log.lock);
+#endif
 }
 
+#define STAT_BEGIN(in)           stats_begin(in)
+#define STAT_END(in, phase)      stats_end(in, phase)
+#define STAT_ADD(in, field, n)   ((in)->stats.field += (n))
+#define STAT_DEPTH_ENTER(in)                                                   \
+    do {                                                                       \
+        if (++(in)->stats.depth > (in)->stats.max_depth)                       \
+            (in)->stats.max_depth = (in)->stats.depth;                         \
+    } while (0)
+#define STAT_DEPTH_LEAVE(in)     ((in)->stats.depth--)
+
+#else /* !SIL_STATS */
+
+#define STAT_BEGIN(in)           ((void)0)
+#define STAT_END(in, phase)      ((void)0)
+#define STAT_ADD(in, field, n)   ((void)0)
+#define STAT_DEPTH_ENTER(in)     ((void)0)
+#define STAT_DEPTH_LEAVE(in)     ((void)0)
+
+#endif /* SIL_STATS */
+
+/* ======================== IDENTIFIER INTERNING ======================== */
 /*
- * expect() - Consume the current token if it matches the expected type.
- * On mismatch, report a syntax error and set had_error.
- * Returns a pointer to the consumed token (or the mismatched one).
+ * Every distinct identifier spelling is assigned a small integer id the
+ * first time the lexer sees it, so later phases compare ids instead of
+ * strings.  Names are copied (NUL-terminated) into a private pool, and
+ * an open-addressing hash table maps spellings to ids.
  */
-static Token *expect(TokenType type) {
-    Token *t = current_token();
-    if (t->type == type) {
-        return advance();
+
+struct InternEntry {
+    size_t   name;   /* offset of the name in intern_pool */
+    int      length; /* name length in bytes              */
+    unsigned hash;   /* hash of the name                  */
+};
+
+/* FNV-1a hash of a byte string */
+static unsigned hash_bytes(const char *s, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
     }
-    fprintf(stderr,
-        "Syntax Error [line %d, col %d]: expected %s but found %s ('%s')\n",
-        t->line, t->col,
-        token_type_name(type),
-        token_type_name(t->type),
-        t->text);
-    had_error = 1;
-    return t;
+    return h;
+}
+
+/* Name of an interned identifier (NUL-terminated) */
+static const char *intern_name(Interp *in, int id) {
+    return in->intern_pool + in->intern_ids[id].name;
 }
 
-/* Forward declarations for recursive descent */
-static int parse_expr(void);
-static int parse_term(void);
-static int parse_factor(void);
+/* Double the hash table and re-insert every id */
+static void intern_grow(Interp *in) {
+    unsigned size = in->intern_mask ? (in->intern_mask + 1) * 2 : 256;
+    free(in->intern_table);
+    in->intern_table = (int *)xmalloc(size * sizeof(int));
+    memset(in->intern_table, -1, size * sizeof(int));
+    in->intern_mask = size - 1;
+    for (int id = 0; id < in->intern_count; id++) {
+        unsigned h = in->intern_ids[id].hash & in->intern_mask;
+        while (in->intern_table[h] != -1) h = (h + 1) & in->intern_mask;
+        in->intern_table[h] = id;
+    }
+}
 
 /*
- * Factor -> INTEGER | IDENTIFIER | "(" Expr ")"
+ * Return the id for the spelling s[0..len), assigning a new one if
+ * needed.  hash must be hash_bytes(s, len).
  */
-static int parse_factor(void) {
-    Token *t = current_token();
+static int intern_hashed(Interp *in, const char *s, int len, unsigned hash) {
+    if ((unsigned)in->intern_count * 2 >= in->intern_mask) intern_grow(in);
 
-    /* INTEGER literal */
-    if (t->type == TOK_INTEGER) {
-        advance();
-        return t->int_value;
+    unsigned h = hash & in->intern_mask;
+    while (in->intern_table[h] != -1) {
+        InternEntry *e = &in->intern_ids[in->intern_table[h]];
+        if (e->hash == hash && e->length == len &&
+            memcmp(in->intern_pool + e->name, s, len) == 0)
+            return in->intern_table[h];
+        h = (h + 1) & in->intern_mask;
     }
 
-    /* IDENTIFIER - look up variable value */
-    if (t->type == TOK_IDENTIFIER) {
-        advance();
-        Variable *v = sym_lookup(t->text);
-        if (!v) {
-            fprintf(stderr,
-                "Semantic Error [line %d, col %d]: undeclared variable '%s'\n",
-                t->line, t->col, t->text);
-            had_error = 1;
-            return 0;
-        }
-        return v->value;
+    if (in->intern_count == in->intern_cap) {
+        in->intern_cap = in->intern_cap ? in->intern_cap * 2 : 256;
+        in->intern_ids = (InternEntry *)xrealloc(in->intern_ids,
+                                             in->intern_cap * sizeof(InternEntry));
     }
-
-    /* Parenthesised expression */
-    if (t->type == TOK_LPAREN) {
-        advance(); /* consume '(' */
-        int val = parse_expr();
-        expect(TOK_RPAREN);
-        return val;
+    if (in->pool_len + len + 1 > in->pool_cap) {
+        while (in->pool_len + len + 1 > in->pool_cap)
+            in->pool_cap = in->pool_cap ? in->pool_cap * 2 : 4096;
+        in->intern_pool = (char *)xrealloc(in->intern_pool, in->pool_cap);
     }
+    memcpy(in->intern_pool + in->pool_len, s, len);
+    in->intern_pool[in->pool_len + len] = '\0';
 
-    /* Error recovery: unexpected token */
-    fprintf(stderr,
-        "Syntax Error [line %d, col %d]: expected expression but found %s ('%s')\n",
-        t->line, t->col,
-        token_type_name(t->type),
-        t->text);
-    had_error = 1;
-    /* Skip the bad token to avoid infinite loops */
-    if (t->type != TOK_EOF) advance();
-    return 0;
+    int id = in->intern_count++;
+    in->intern_ids[id].name   = in->pool_len;
+    in->intern_ids[id].length = len;
+    in->intern_ids[id].hash   = hash;
+    in->pool_len += len + 1;
+    in->intern_table[h] = id;
+    return id;
+}
+
+static int intern(Interp *in, const char *s, int len) {
+    return intern_hashed(in, s, len, hash_bytes(s, len));
 }
 
+/* ======================== TOKENISER (LEXER) ======================== */
 /*
- * Term -> Factor (( "*" | "/" ) Factor)*
+ * The lexer is pull-based: next_token() scans exactly one token from the
+ * source each time it is called, so the parser can start work before the
+ * whole file has been lexed and memory use does not grow with the input.
+ * The parser reads through a small ring buffer of lookahead tokens that
+ * is refilled on demand (see current_token()/advance() below).
+ *
+ * Runs of blanks, identifiers and numbers are scanned LEX_W bytes at a
+ * time with SSE2, AVX2 (when built with -mavx2) or NEON; other targets
+ * use the scalar loops, which produce the same tokens and positions.
  */
-static int parse_term(void) {
-    int left = parse_factor();
-
-    while (check(TOK_STAR) || check(TOK_SLASH)) {
-        Token *op = advance();
-        int right = parse_factor();
-        if (op->type == TOK_STAR) {
-            left = left * right;
-        } else {
-            if (right == 0) {
-                fprintf(stderr,
-                    "Runtime Error [line %d, col %d]: division by zero\n",
-                    op->line, op->col);
-                had_error = 1;
-                left = 0;
-            } else {
-                left = left / right;
-            }
-        }
-    }
-    return left;
-}
 
 /*
- * Expr -> Term (( "+" | "-" ) Term)*
+ * Character classes.  The scanner classifies bytes through char_class[]
+ * instead of <ctype.h>, so the result never depends on the locale; bytes
+ * outside 7-bit ASCII are CC_OTHER.
  */
-static int parse_expr(void) {
-    int left = parse_term();
+enum {
+    CC_OTHER,   /* operators, punctuation, anything unexpected */
+    CC_SPACE,   /* ' ' '\t' '\r'                               */
+    CC_NEWLINE, /* '\n'                                        */
+    CC_DIGIT,   /* 0-9                                         */
+    CC_ALPHA    /* a-z A-Z _                                   */
+};
 
-    while (check(TOK_PLUS) || check(TOK_MINUS)) {
-        Token *op = advance();
-        int right = parse_term();
-        if (op->type == TOK_PLUS) {
-            left = left + right;
-        } else {
-            left = left - right;
-        }
-    }
-    return left;
-}
+#define O CC_OTHER
+#define S CC_SPACE
+#define N CC_NEWLINE
+#define D CC_DIGIT
+#define A CC_ALPHA
+static const unsigned char char_class[256] = {
+    O, O, O, O, O, O, O, O, O, S, N, O, O, S, O, O,  /* 0x00 */
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  /* 0x10 */
+    S, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  /* 0x20  !"#$%&'()*+,-./ */
+    D, D, D, D, D, D, D, D, D, D, O, O, O, O, O, O,  /* 0x30 0-9 :;<=>?      */
+    O, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,  /* 0x40 @A-O            */
+    A, A, A, A, A, A, A, A, A, A, A, O, O, O, O, A,  /* 0x50 P-Z [\]^_       */
+    O, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,  /* 0x60 `a-o            */
+    A, A, A, A, A, A, A, A, A, A, A, O, O, O, O, O   /* 0x70 p-z {|}~        */
+};
+#undef O
+#undef S
+#undef N
+#undef D
+#undef A
+
+#define CLASS(c) char_class[(unsigned char)(c)]
 
 /*
- * Declaration -> "int" IDENTIFIER "=" Expr ";"
+ * Vector scanning.  Each LexVec holds LEX_W source bytes; lv_mask()
+ * turns a byte-wise comparison into an integer with LEX_BITS bits per
+ * byte (NEON has no movemask, so it keeps four), lowest address first.
+ * Blocks are only loaded while LEX_W bytes remain; the tail of the
+ * buffer is finished by the scalar loops, which give identical results.
  */
-static void parse_declaration(void) {
-    expect(TOK_INT);   /* consume "int" */
+#if LEX_SIMD && defined(__AVX2__)
 
-    Token *id = expect(TOK_IDENTIFIER);
+#define LEX_W    32
+#define LEX_BITS 1
+typedef __m256i LexVec;
+static inline LexVec   lv_load(const char *p)       { return _mm256_loadu_si256((const __m256i *)p); }
+static inline LexVec   lv_eq(LexVec v, char c)      { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)); }
+static inline LexVec   lv_or(LexVec a, LexVec b)    { return _mm256_or_si256(a, b); }
+static inline uint64_t lv_mask(LexVec v)            { return (uint32_t)_mm256_movemask_epi8(v); }
+/* lo <= v <= hi; bytes >= 0x80 compare as negative and never match */
+static inline LexVec   lv_range(LexVec v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8((char)(lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(hi + 1)), v));
+}
+static inline LexVec   lv_lower(LexVec v)           { return _mm256_or_si256(v, _mm256_set1_epi8(0x20)); }
 
-    expect(TOK_ASSIGN); /* consume "=" */
+#elif LEX_SIMD && defined(__SSE2__)
 
-    int value = parse_expr();
+#define LEX_W    16
+#define LEX_BITS 1
+typedef __m128i LexVec;
+static inline LexVec   lv_load(const char *p)       { return _mm_loadu_si128((const __m128i *)p); }
+static inline LexVec   lv_eq(LexVec v, char c)      { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+static inline LexVec   lv_or(LexVec a, LexVec b)    { return _mm_or_si128(a, b); }
+static inline uint64_t lv_mask(LexVec v)            { return (uint32_t)_mm_movemask_epi8(v); }
+static inline LexVec   lv_range(LexVec v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1))),
+                         _mm_cmpgt_epi8(_mm_set1_epi8((char)(hi + 1)), v));
+}
+static inline LexVec   lv_lower(LexVec v)           { return _mm_or_si128(v, _mm_set1_epi8(0x20)); }
 
-    expect(TOK_SEMICOLON); /* consume ";" */
+#elif LEX_SIMD && defined(__ARM_NEON)
 
-    /* Semantic action: declare the variable and store the value */
-    if (!had_error) {
-        Variable *v = sym_declare(id->text, id->line);
-        if (v) {
-            v->value = value;
+#define LEX_W    16
+#define LEX_BITS 4
+typedef uint8x16_t LexVec;
+static inline LexVec   lv_load(const char *p)       { return vld1q_u8((const uint8_t *)p); }
+static inline LexVec   lv_eq(LexVec v, char c)      { return vceqq_u8(v, vdupq_n_u8((uint8_t)c)); }
+static inline LexVec   lv_or(LexVec a, LexVec b)    { return vorrq_u8(a, b); }
+static inline uint64_t lv_mask(LexVec v) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+}
+static inline LexVec   lv_range(LexVec v, char lo, char hi) {
+    return vandq_u8(vcgeq_u8(v, vdupq_n_u8((uint8_t)lo)), vcleq_u8(v, vdupq_n_u8((uint8_t)hi)));
+}
+static inline LexVec   lv_lower(LexVec v)           { return vorrq_u8(v, vdupq_n_u8(0x20)); }
+
+#else
+
+#undef  LEX_SIMD
+#define LEX_SIMD 0
+
+#endif
+
+#if LEX_SIMD
+/* Mask with a bit set (LEX_BITS of them) for every byte in the block */
+#define LEX_ALL (LEX_W * LEX_BITS == 64 ? ~0ull : (1ull << (LEX_W * LEX_BITS)) - 1)
+
+/* Bytes that may continue an identifier: a-z A-Z 0-9 _ */
+static inline uint64_t ident_mask(LexVec v) {
+    return lv_mask(lv_or(lv_or(lv_range(lv_lower(v), 'a', 'z'), lv_range(v, '0', '9')),
+                         lv_eq(v, '_')));
+}
+#endif
+
+/*
+ * Skip spaces, tabs, carriage returns and newlines starting at src[i],
+ * keeping *line and *col in step.  Returns the index of the next byte
+ * that is not blank (or len).
+ */
+static size_t skip_blanks(const char *src, size_t len, size_t i, int *line, int *col) {
+#if LEX_SIMD
+    /* Most runs are a single space or newline: only vectorise longer ones */
+    for (int k = 0; k < 2 && i < len; k++, i++) {
+        int c = CLASS(src[i]);
+        if (c == CC_SPACE) {
+            (*col)++;
+        } else if (c == CC_NEWLINE) {
+            (*line)++;
+            *col = 1;
+        } else {
+            return i;
+        }
+    }
+    while (i + LEX_W <= len) {
+        LexVec   v     = lv_load(src + i);
+        uint64_t nl    = lv_mask(lv_eq(v, '\n'));
+        uint64_t blank = nl | lv_mask(lv_or(lv_or(lv_eq(v, ' '), lv_eq(v, '\t')), lv_eq(v, '\r')));
+        uint64_t stop  = ~blank & LEX_ALL;
+        int      n     = stop ? __builtin_ctzll(stop) / LEX_BITS : LEX_W;
+
+        /* Only newlines before the stopping byte count */
+        if (n < LEX_W) nl &= (1ull << (n * LEX_BITS)) - 1;
+        if (nl) {
+            int last = (63 - __builtin_clzll(nl)) / LEX_BITS;
+            *line += __builtin_popcountll(nl) / LEX_BITS;
+            *col   = n - last;
+        } else {
+            *col  += n;
+        }
+        i += n;
+        if (stop) return i;
+    }
+#endif
+    while (i < len) {
+        int c = CLASS(src[i]);
+        if (c == CC_SPACE) {
+            (*col)++;
+        } else if (c == CC_NEWLINE) {
+            (*line)++;
+            *col = 1;
         } else {
-            had_error = 1; /* redeclaration error already printed */
+            break;
         }
+        i++;
+    }
+    return i;
+}
+
+/* Index just past the identifier characters starting at src[i] */
+static size_t scan_ident(const char *src, size_t len, size_t i) {
+#if LEX_SIMD
+    /* Short names are finished before a vector load would pay off */
+    for (int k = 0; k < 8; k++, i++)
+        if (i >= len || CLASS(src[i]) < CC_DIGIT) return i;
+    while (i + LEX_W <= len) {
+        uint64_t stop = ~ident_mask(lv_load(src + i)) & LEX_ALL;
+        if (stop) return i + __builtin_ctzll(stop) / LEX_BITS;
+        i += LEX_W;
     }
+#endif
+    while (i < len && CLASS(src[i]) >= CC_DIGIT) i++;
+    return i;
 }
 
+/* One case of keyword_type(): the keyword whose first byte matched */
+#define KEYWORD(rest, type) \
+    return memcmp(s + 1, rest, sizeof(rest) - 1) == 0 ? (type) : TOK_IDENTIFIER
+
 /*
- * PrintStmt -> "print" "(" Expr ")" ";"
+ * The keyword spelt by the n bytes at s, or TOK_IDENTIFIER.  Switching
+ * on the length and then the first byte leaves at most one comparison
+ * per identifier, however many keywords there are; a new keyword is one
+ * more case, and keywords sharing a length and first byte are told
+ * apart by a switch on the next byte.
  */
-static void parse_print(void) {
-    expect(TOK_PRINT);  /* consume "print" */
-    expect(TOK_LPAREN); /* consume "("     */
-
-    int value = parse_expr();
+static TokenType keyword_type(const char *s, int n) {
+    switch (n) {
+    case 3:
+        switch (s[0]) {
+        case 'i': KEYWORD("nt", TOK_INT);
+        }
+        break;
+    case 5:
+        switch (s[0]) {
+        case 'p': KEYWORD("rint", TOK_PRINT);
+        }
+        break;
+    }
+    return TOK_IDENTIFIER;
+}
 
-    expect(TOK_RPAREN);    /* consume ")" */
-    expect(TOK_SEMICOLON); /* consume ";" */
+#undef KEYWORD
 
-    /* Execute: print the value only if no errors so far */
-    if (!had_error) {
-        printf("%d\n", value);
+/* Index just past the decimal digits starting at src[i] */
+static size_t scan_digits(const char *src, size_t len, size_t i) {
+#if LEX_SIMD
+    for (int k = 0; k < 8; k++, i++)
+        if (i >= len || CLASS(src[i]) != CC_DIGIT) return i;
+    while (i + LEX_W <= len) {
+        uint64_t stop = ~lv_mask(lv_range(lv_load(src + i), '0', '9')) & LEX_ALL;
+        if (stop) return i + __builtin_ctzll(stop) / LEX_BITS;
+        i += LEX_W;
     }
+#endif
+    while (i < len && CLASS(src[i]) == CC_DIGIT) i++;
+    return i;
 }
 
 /*
- * Stmt -> Declaration | PrintStmt
+ * Value of the eight ASCII digits at p, converted together in one
+ * 64-bit word (SWAR): adjacent digits are combined into pairs, the pairs
+ * into groups of four and the groups into the result.
  */
-static void parse_stmt(void) {
-    Token *t = current_token();
-
-    if (t->type == TOK_INT) {
-        parse_declaration();
-    } else if (t->type == TOK_PRINT) {
-        parse_print();
-    } else {
-        fprintf(stderr,
-            "Syntax Error [line %d, col %d]: expected 'int' or 'print' "
-            "at start of statement but found %s ('%s')\n",
-            t->line, t->col,
-            token_type_name(t->type),
-            t->text);
-        had_error = 1;
-        /* Skip token for error recovery */
-        if (t->type != TOK_EOF) advance();
-    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_DIGITS 1
+static inline uint32_t parse_8_digits(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    v -= 0x3030303030303030ull;
+    v  = v * 10 + (v >> 8);
+    v  = ((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32)) +
+          ((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32))) >> 32;
+    return (uint32_t)v;
 }
+#else
+#define SWAR_DIGITS 0
+#endif
 
 /*
- * Program -> StmtList EOF
- * StmtList -> Stmt StmtList | epsilon
+ * Convert the decimal digits src[start..end) into *value.  Returns -1
+ * as soon as the number is known to exceed VALUE_MAX, so arbitrarily
+ * long literals are safe.
  */
-static void parse_program(void) {
-    while (!check(TOK_EOF)) {
-        parse_stmt();
+static int digits_value(const char *src, size_t start, size_t end, uint64_t *value) {
+    uint64_t v = 0;
+    size_t   k = start;
+#if SWAR_DIGITS
+    for (; end - k >= 8; k += 8) {
+        uint32_t d = parse_8_digits(src + k);
+        if (v > ((uint64_t)VALUE_MAX - d) / 100000000u) return -1;
+        v = v * 100000000u + d;
+    }
+#endif
+    for (; k < end; k++) {
+        unsigned d = (unsigned)(src[k] - '0');
+        if (v > ((uint64_t)VALUE_MAX - d) / 10) return -1;
+        v = v * 10 + d;
     }
-    expect(TOK_EOF);
+    *value = v;
+    return 0;
 }
 
-/* ======================== FILE READING ======================== */
+/* Index of the newline ending the comment at src[i] (or len) */
+static size_t skip_comment(const char *src, size_t len, size_t i) {
+    const char *nl = (const char *)memchr(src + i, '\n', len - i);
+    return nl ? (size_t)(nl - src) : len;
+}
+
+/* Reset the lexer to the start of a new source buffer */
+static void lex_init(Interp *in, const char *src, size_t len) {
+    in->lex_src   = src;
+    in->lex_len   = len;
+    in->lex_pos   = 0;
+    in->lex_line  = 1;
+    in->lex_col   = 1;
+    in->lex_error = 0;
+}
+
+/* Fill *tok with an EOF token at the current source position */
+static void make_eof(Interp *in, Token *tok) {
+    tok->type   = TOK_EOF;
+    tok->offset = in->lex_pos;
+    tok->length = 3; /* printed as "EOF", see lexeme() */
+    tok->value  = 0;
+    tok->line   = in->lex_line;
+    tok->col    = in->lex_col;
+}
+
+/* Text of a token's lexeme; print with "%.*s" and t->length */
+static const char *lexeme(Interp *in, const Token *t) {
+    return t->type == TOK_EOF ? "EOF" : in->lex_src + t->offset;
+}
 
 /*
- * read_file() - Reads the entire contents of a file into a
- * dynamically allocated string.  Returns NULL on failure.
+ * next_token() - Scans the next token from the source into *tok.
+ * At the end of input (or after a lexical error, which is reported
+ * once and sets lex_error) it keeps returning TOK_EOF.
+ * Returns 0 on success, -1 on a lexical error.
  */
-static char *read_file(const char *path) {
-    FILE *fp = fopen(path, "rb");
-    if (!fp) {
-        fprintf(stderr, "Error: cannot open file '%s'\n", path);
-        return NULL;
-    }
+static int plex_next(Interp *in, Token *tok);
 
-    fseek(fp, 0, SEEK_END);
-    long length = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+static int next_token(Interp *in, Token *tok) {
+    const char *src = in->lex_src;
+    size_t len  = in->lex_len;
+    size_t i    = in->lex_pos;
+    int    line = in->lex_line;
+    int    col  = in->lex_col;
 
-    char *buf = (char *)malloc(length + 1);
-    if (!buf) {
-        fprintf(stderr, "Error: out of memory\n");
-        fclose(fp);
-        return NULL;
+    if (in->lex_error) {
+        make_eof(in, tok);
+        return -1;
     }
+    if (in->plex) return plex_next(in, tok);
 
-    fread(buf, 1, length, fp);
-    buf[length] = '\0';
-    fclose(fp);
-    return buf;
-}
+    while (i < len) {
+        int cls = CLASS(src[i]);
 
-/* ======================== MAIN ======================== */
+        /* ---------- skip whitespace ---------- */
+        if (cls == CC_SPACE || cls == CC_NEWLINE) {
+            i = skip_blanks(src, len, i, &line, &col);
+            continue;
+        }
 
-int main(int argc, char *argv[]) {
-    /* --- Check command-line arguments --- */
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <source_file>\n", argv[0]);
-        return 1;
-    }
+        /* ---------- skip single-line comments // ----------
+           (the comment text does not advance col) */
+        if (src[i] == '/' && i + 1 < len && src[i + 1] == '/') {
+            i = skip_comment(src, len, i + 2);
+            continue;
+        }
+
+        /* ---------- identifiers & keywords ---------- */
+        if (cls == CC_ALPHA) {
+            size_t start = i;
+            int start_col = col;
+            i = scan_ident(src, len, i + 1);
+            int n = (int)(i - start);
+            col += n;
 
-    /* --- Read source file --- */
-    char *source = read_file(argv[1]);
-    if (!source) return 1;
+            tok->offset = start;
+            tok->length = n;
+            tok->value  = 0;
+            tok->line   = line;
+            tok->col    = start_col;
 
-    /* --- Phase 1: Tokenisation --- */
-    if (tokenise(source) != 0) {
-        free(source);
-        return 1;
-    }
+            tok->type = keyword_type(&src[start], n);
+            if (tok->type == TOK_IDENTIFIER)
+                tok->value = in->lex_defer ? (Value)hash_bytes(&src[start], n)
+                                           : intern(in, &src[start], n);
+            goto done;
+        }
+
+        /* ---------- integer literals ---------- */
+        if (cls == CC_DIGIT) {
+            size_t start = i;
+            int start_col = col;
+            i = scan_digits(src, len, i + 1);
+            col += (int)(i - start);
 
-    /* --- Phase 2 & 3: Parsing + Execution --- */
-    pos       = 0;
-    had_error = 0;
-    sym_count = 0;
+            /* Check that the integer is not immediately followed by a letter
+               (e.g., "123abc" is not valid) */
+            if (i < len && CLASS(src[i]) == CC_ALPHA) {
+                diag(in, DIAG_LEXICAL, line, start_col,
+                    "invalid token '%c' after integer literal", src[i]);
+                goto fail;
+            }
+
+            uint64_t value;
+            if (digits_value(src, start, i, &value) != 0) {
+                diag(in, DIAG_LEXICAL, line, start_col,
+                    "integer literal '%.*s' is out of range (maximum " VALUE_MAX_TEXT ")",
+                    (int)(i - start), &src[start]);
+                goto fail;
+            }
 
-    parse_program();
+            tok->type   = TOK_INTEGER;
+            tok->offset = start;
+            tok->length = (int)(i - start);
+            tok->value  = (Value)value;
+            tok->line   = line;
+            tok->col    = start_col;
+            goto done;
+        }
 
-    free(source);
+        /* ---------- single-character tokens ---------- */
+        tok->offset = i;
+        tok->length = 1;
+        tok->value  = 0;
+        tok->line   = line;
+        tok->col    = col;
 
-    if (had_error) {
-        fprintf(stderr, "\nParsing/execution failed due to errors above.\n");
-        return 1;
+        switch (src[i]) {
+            case '=': tok->type = TOK_ASSIGN;    break;
+            case '+': tok->type = TOK_PLUS;      break;
+            case '-': tok->type = TOK_MINUS;     break;
+            case '*': tok->type = TOK_STAR;      break;
+            case '/': tok->type = TOK_SLASH;     break;
+            case '(': tok->type = TOK_LPAREN;    break;
+            case ')': tok->type = TOK_RPAREN;    break;
+            case ';': tok->type = TOK_SEMICOLON; break;
+            default:
+                diag(in, DIAG_LEXICAL, line, col,
+                    "unexpected character '%c'", src[i]);
+                goto fail;
+        }
+        i++;
+        col++;
+        goto done;
     }
 
+    /* End of input */
+    in->lex_pos  = i;
+    in->lex_line = line;
+    in->lex_col  = col;
+    make_eof(in, tok);
+    return 0;
+
+done:
+    in->lex_pos  = i;
+    in->lex_line = line;
+    in->lex_col  = col;
     return 0;
+
+fail:
+    in->lex_pos   = i;
+    in->lex_line  = line;
+    in->lex_col   = col;
+    in->lex_error = 1;
+    make_eof(in, tok);
+    return -1;
+}
+
+/* ======================== PARALLEL LEXER ======================== */
+/*
+ * Inputs of at least PLEX_MIN_SIZE bytes can be tokenised by worker
+ * threads running ahead of the parser (InterpOptions.lex_threads).  The
+ * source is cut into chunks of about PLEX_CHUNK bytes, each ending just
+ * after a ';' outside any comment.  No token spans a ';' and comments
+ * end at a newline, so every chunk lexes exactly as it would in one
+ * serial pass, and a token's column is simply its distance from the
+ * last newline.
+ *
+ * Each worker lexes with its own scratch Interp: lines are counted from
+ * 0 and offset by the consumer, identifiers are only hashed (the parser
+ * thread interns them in source order, so ids match the serial lexer),
+ * and the first lexical error of a chunk is captured and only reported
+ * if the parser actually reaches it.  At most two chunks per worker are
+ * buffered, so memory use does not grow with the input.
+ */
+
+#define PLEX_MIN_SIZE (4u << 20)   /* smaller inputs are lexed serially */
+#define PLEX_CHUNK    (256u << 10)
+
+#if HAVE_PTHREADS
+
+typedef struct {
+    Token   *toks;
+    int      count, cap;
+    size_t   end_pos;      /* lexer state where the chunk stopped; */
+    int      end_line;     /*   end_line counts the chunk's newlines */
+    int      end_col;
+    int      failed;       /* stopped at a lexical error: err_*    */
+    DiagKind err_kind;
+    int      err_line, err_col;
+    char     err_msg[512];
+    int      ready;        /* lexed and not yet consumed           */
+} PlexChunk;
+
+struct ParLexer {
+    const char     *src;
+    size_t          len;
+    int             nchunks;
+    PlexChunk      *ring;      /* chunk k lives in ring[k % ring_size] */
+    int             ring_size;
+    int             next_job;  /* next chunk for a worker             */
+    int             consumed;  /* chunks the parser has finished      */
+    int             stop;
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    pthread_t      *threads;
+    int             nthreads;
+
+    /* parser side */
+    int             cur;       /* chunk being read          */
+    int             pos;       /* next token in it          */
+    int             have_cur;  /* cur is known to be ready  */
+    int             line_base; /* line of the chunk's line 0 */
+};
+
+/* Start of the line holding src[end] (or the end of input) */
+static size_t plex_line_start(const char *src, size_t end) {
+    while (end > 0 && src[end - 1] != '\n') end--;
+    return end;
 }
+
+/*
+ * Where the chunk nominally starting at pos really starts: just past
+ * the first ';' outside a comment on a line that begins after pos.
+ * Starting from a line boundary means the scan always knows whether it
+ * is inside a comment.  *line_start is set to the start of that line;
+ * with no such ';' the chunk is empty, starting at the end of input.
+ */
+static size_t plex_split(const char *src, size_t len, size_t pos, size_t *line_start) {
+    *line_start = 0;
+    if (pos == 0) return 0;
+    if (pos >= len) {
+        *line_start = plex_line_start(src, len);
+        return len;
+    }
+
+    const char *nl = (const char *)memchr(src + pos, '\n', len - pos);
+    if (!nl) {
+        *line_start = plex_line_start(src, len);
+        return len;
+    }
+    size_t i = (size_t)(nl - src) + 1, ls = i;
+    while (i < len) {
+        char c = src[i];
+        if (c == '\n') {
+            ls = i + 1;
+        } else if (c == '/' && i + 1 < len && src[i + 1] == '/') {
+            i = skip_comment(src, len, i);
+            continue;
+        } else if (c == ';') {
+            *line_start = ls;
+            return i + 1;
+        }
+        i++;
+    }
+    *line_start = ls;
+    return len;
+}
+
+/* Diagnostics from a worker's scratch context land in its chunk */
+static void plex_capture(void *user, DiagKind kind, int line, int col, const char *msg) {
+    PlexChunk *c = (PlexChunk *)user;
+    c->err_kind = kind;
+    c->err_line = line;
+    c->err_col  = col;
+    snprintf(c->err_msg, sizeof(c->err_msg), "%s", msg);
+}
+
+/* Lex chunk k into c using the worker context w */
+static void plex_lex_chunk(Interp *w, const ParLexer *pl, int k, PlexChunk *c) {
+    size_t ls, unused;
+    size_t start = plex_split(pl->src, pl->len, (size_t)k * PLEX_CHUNK, &ls);
+    size_t end   = plex_split(pl->src, pl->len, (size_t)(k + 1) * PLEX_CHUNK, &unused);
+
+    lex_init(w, pl->src, end);
+    w->lex_pos   = start;
+    w->lex_line  = 0;
+    w->lex_col   = (int)(start - ls) + 1;
+    w->diag_user = c;
+    c->count  = 0;
+    c->failed = 0;
+
+    for (;;) {
+        if (c->count == c->cap) {
+            c->cap  = c->cap ? c->cap * 2 : 4096;
+            c->toks = (Token *)xrealloc(c->toks, c->cap * sizeof(Token));
+        }
+        Token *t = &c->toks[c->count];
+        if (next_token(w, t) != 0) {
+            c->failed = 1;
+            break;
+        }
+        if (t->type == TOK_EOF) break;
+        c->count++;
+    }
+    c->end_pos  = w->lex_pos;
+    c->end_line = w->lex_line;
+    c->end_col  = w->lex_col;
+}
+
+static void *plex_worker(void *arg) {
+    ParLexer *pl = (ParLexer *)arg;
+    Interp   *w  = (Interp *)xmalloc(sizeof(Interp));
+    interp_init(w, NULL, NULL);
+    w->lex_defer = 1;
+    w->diag_fn   = plex_capture;
+
+    for (;;) {
+        pthread_mutex_lock(&pl->lock);
+        while (!pl->stop && pl->next_job < pl->nchunks &&
+               pl->next_job >= pl->consumed + pl->ring_size)
+            pthread_cond_wait(&pl->changed, &pl->lock);
+        if (pl->stop || pl->next_job >= pl->nchunks) {
+            pthread_mutex_unlock(&pl->lock);
+            break;
+        }
+        int k = pl->next_job++;
+        pthread_mutex_unlock(&pl->lock);
+
+        PlexChunk *c = &pl->ring[k % pl->ring_size];
+        plex_lex_chunk(w, pl, k, c);
+
+        pthread_mutex_lock(&pl->lock);
+        c->ready = 1;
+        pthread_cond_broadcast(&pl->changed);
+        pthread_mutex_unlock(&pl->lock);
+    }
+
+    interp_release(w);
+    free(w);
+    return NULL;
+}
+
+/* Start worker threads for the source set up by lex_init(), if it is large */
+static void plex_begin(Interp *in) {
+    int threads = in->opt.lex_threads;
+    if (threads < 2 || in->lex_len < PLEX_MIN_SIZE) return;
+
+    ParLexer *pl = (ParLexer *)xmalloc(sizeof(ParLexer));
+    memset(pl, 0, sizeof(*pl));
+    pl->src       = in->lex_src;
+    pl->len       = in->lex_len;
+    pl->nchunks   = (int)((pl->len + PLEX_CHUNK - 1) / PLEX_CHUNK);
+    pl->ring_size = threads * 2;
+    pl->ring      = (PlexChunk *)xmalloc(pl->ring_size * sizeof(PlexChunk));
+    memset(pl->ring, 0, pl->ring_size * sizeof(PlexChunk));
+    pl->line_base = 1;
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->changed, NULL);
+
+    pl->threads = (pthread_t *)xmalloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&pl->threads[t], NULL, plex_worker, pl) != 0) break;
+        pl->nthreads++;
+    }
+    if (pl->nthreads == 0) {
+        /* No threads available: stay serial */
+        pthread_mutex_destroy(&pl->lock);
+        pthread_cond_destroy(&pl->changed);
+        free(pl->threads);
+        free(pl->ring);
+        free(pl);
+        return;
+    }
+    in->plex = pl;
+}
+
+/* Stop the workers and go back to serial lexing */
+static void plex_end(Interp *in) {
+    ParLexer *pl = in->plex;
+    if (!pl) return;
+
+    pthread_mutex_lock(&pl->lock);
+    pl->stop = 1;
+    pthread_cond_broadcast(&pl->changed);
+    pthread_mutex_unlock(&pl->lock);
+    for (int t = 0; t < pl->nthreads; t++) pthread_join(pl->threads[t], NULL);
+
+    for (int i = 0; i < pl->ring_size; i++) free(pl->ring[i].toks);
+    pthread_mutex_destroy(&pl->lock);
+    pthread_cond_destroy(&pl->changed);
+    free(pl->threads);
+    free(pl->ring);
+    free(pl);
+    in->plex = NULL;
+}
+
+/* next_token() for the parser while the workers are running */
+static int plex_next(Interp *in, Token *tok) {
+    ParLexer *pl = in->plex;
+
+    for (;;) {
+        PlexChunk *c = &pl->ring[pl->cur % pl->ring_size];
+        if (!pl->have_cur) {
+            pthread_mutex_lock(&pl->lock);
+            while (!c->ready) pthread_cond_wait(&pl->changed, &pl->lock);
+            pthread_mutex_unlock(&pl->lock);
+            pl->have_cur = 1;
+        }
+
+        if (pl->pos < c->count) {
+            *tok = c->toks[pl->pos++];
+            tok->line += pl->line_base;
+            if (tok->type == TOK_IDENTIFIER)
+                tok->value = intern_hashed(in, in->lex_src + tok->offset, tok->length,
+                                           (unsigned)tok->value);
+            return 0;
+        }
+
+        /* Chunk used up: leave the lexer where the chunk stopped */
+        in->lex_pos  = c->end_pos;
+        in->lex_line = pl->line_base + c->end_line;
+        in->lex_col  = c->end_col;
+
+        if (c->failed) {
+            diag(in, c->err_kind, pl->line_base + c->err_line, c->err_col, "%s", c->err_msg);
+            in->lex_error = 1;
+            plex_end(in);
+            make_eof(in, tok);
+            return -1;
+        }
+        if (pl->cur + 1 == pl->nchunks) {
+            /* The last chunk ends at the end of input */
+            plex_end(in);
+            return next_token(in, tok);
+        }
+
+        /* Hand the slot back; a worker may refill it at once */
+        pl->line_base += c->end_line;
+        pthread_mutex_lock(&pl->lock);
+        c->ready = 0;
+        pl->consumed++;
+        pthread_cond_broadcast(&pl->changed);
+        pthread_mutex_unlock(&pl->lock);
+        pl->cur++;
+        pl->pos      = 0;
+        pl->have_cur = 0;
+    }
+}
+
+#else /* no threads */
+
+static void plex_begin(Interp *in) { (void)in; }
+static void plex_end(Interp *in)   { (void)in; }
+static int  plex_next(Interp *in, Token *tok) { (void)in; (void)tok; return -1; }
+
+#endif /* HAVE_PTHREADS */
+
+/* ======================== SYMBOL TABLE ======================== */
+/*
+ * A simple variable store: maps identifier names to integer values.
+ * Used for semantic checking (undeclared / redeclared variables)
+ * and for execution (storing and retrieving values).
+ *
+ * Variables are keyed by their interned identifier id in an
+ * open-addressing hash table (linear probing) that doubles when it is
+ * half full, so lookups are O(1) and there is no fixed variable limit.
+ *
+ * The table only resolves names: each variable is given a dense slot
+ * number on declaration and its value lives in slot_values[slot], so
+ * code that has already resolved a name reads it with a single load.
+ */
+
+struct Variable {
+    int ident; /* interned identifier id, or -1 for an empty entry */
+    int slot;  /* index into slot_values[]                         */
+};
+
+/* Home slot of an identifier id (Fibonacci hashing) */
+static unsigned sym_hash(Interp *in, int ident) {
+    return ((unsigned)ident * 2654435761u) & in->sym_mask;
+}
+
+/* Empty the table, keeping its storage */
+static void sym_reset(Interp *in) {
+    for (unsigned i = 0; in->sym_table && i <= in->sym_mask; i++)
+        in->sym_table[i].ident = -1;
+    in->sym_count = 0;
+}
+
+/* Double the table and re-insert every variable */
+static void sym_grow(Interp *in) {
+    Variable *old      = in->sym_table;
+    unsigned  old_size = old ? in->sym_mask + 1 : 0;
+    unsigned  size     = old_size ? old_size * 2 : 256;
+
+    in->sym_table = (Variable *)xmalloc(size * sizeof(Variable));
+    in->sym_mask  = size - 1;
+    for (unsigned i = 0; i < size; i++) in->sym_table[i].ident = -1;
+
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old[i].ident < 0) continue;
+        unsigned h = sym_hash(in, old[i].ident);
+        while (in->sym_table[h].ident != -1) h = (h + 1) & in->sym_mask;
+        in->sym_table[h] = old[i];
+    }
+    free(old);
+}
+
+/* Make sure slot_values[] has room for n slots */
+static void slots_reserve(Interp *in, int n) {
+    if (n <= in->slot_cap) return;
+    while (in->slot_cap < n) in->slot_cap = in->slot_cap ? in->slot_cap * 2 : 256;
+    in->slot_values = (Value *)xrealloc(in->slot_values, in->slot_cap * sizeof(Value));
+}
+
+/* Look up a variable; returns pointer or NULL */
+static Variable *sym_lookup(Interp *in, int ident) {
+    if (!in->sym_table) return NULL;
+    unsigned h = sym_hash(in, ident);
+    STAT_ADD(in, sym_probes, 1);
+    while (in->sym_table[h].ident != -1) {
+        if (in->sym_table[h].ident == ident) return &in->sym_table[h];
+        h = (h + 1) & in->sym_mask;
+        STAT_ADD(in, sym_probes, 1);
+    }
+    return NULL;
+}
+
+/* Declare a new variable; returns pointer or NULL on redeclaration */
+static Variable *sym_declare(Interp *in, int ident, int line) {
+    if (sym_lookup(in, ident)) {
+        diag(in, DIAG_SEMANTIC, line, 0,
+            "variable '%s' is already declared", intern_name(in, ident));
+        return NULL;
+    }
+    if (!in->sym_table || (unsigned)(in->sym_count + 1) * 2 > in->sym_mask + 1) sym_grow(in);
+
+    unsigned h = sym_hash(in, ident);
+    STAT_ADD(in, sym_probes, 1);
+    while (in->sym_table[h].ident != -1) {
+        h = (h + 1) & in->sym_mask;
+        STAT_ADD(in, sym_probes, 1);
+    }
+    slots_reserve(in, in->sym_count + 1);
+    Variable *v = &in->sym_table[h];
+    v->ident = ident;
+    v->slot  = in->sym_count++;
+    in->slot_values[v->slot] = 0;
+    return v;
+}
+
+/* ======================== ABSTRACT SYNTAX TREE ======================== */
+/*
+ * The parser turns each statement into a small tree of Nodes.
+ * Identifiers are resolved to slots while parsing, so evaluating a tree
+ * never looks at names.
+ */
+
+typedef enum {
+    N_NUM,  /* integer literal: value                 */
+    N_VAR,  /* variable reference: value = slot       */
+    N_ADD,  /* lhs + rhs                              */
+    N_SUB,  /* lhs - rhs                              */
+    N_MUL,  /* lhs * rhs                              */
+    N_DIV,  /* lhs / rhs, line/col of the '/' operator */
+    N_SAVE  /* lhs, also stored in slot value          */
+} NodeKind;
+
+typedef struct Node {
+    NodeKind     kind;
+    Value        value; /* literal value or slot          */
+    int          line;  /* position of the token or '/'  */
+    int          col;
+    struct Node *lhs;
+    struct Node *rhs;
+} Node;
+
+typedef enum {
+    S_DECL,  /* "int" IDENTIFIER "=" Expr ";" */
+    S_PRINT  /* "print" "(" Expr ")" ";"     */
+} StmtKind;
+
+typedef struct Stmt {
+    StmtKind     kind;
+    int          slot; /* S_DECL: target slot, -1 if not declared */
+    Node        *expr;
+    struct Stmt *next;
+} Stmt;
+
+/* A whole parsed program: statements in source order */
+typedef struct {
+    Stmt *first;
+    Stmt *last;
+    int   stmt_count;
+    int   slot_count; /* variables plus optimiser temporaries */
+} Program;
+
+/*
+ * Passes over a tree other than parsing and evaluation visit its nodes
+ * from a NodeList (declared with Interp) built with an explicit stack,
+ * so that deep trees cannot overflow the C stack.
+ */
+
+static void nodes_push(NodeList *l, Node *n) {
+    l->items = (Node **)stack_reserve(l->items, &l->cap, l->count + 1, sizeof(Node *));
+    l->items[l->count++] = n;
+}
+
+/* Fill out with the tree at n in evaluation order: lhs, rhs, node */
+static void nodes_postorder(NodeList *out, NodeList *tmp, Node *n) {
+    out->count = tmp->count = 0;
+    nodes_push(tmp, n);
+    while (tmp->count > 0) {
+        Node *x = tmp->items[--tmp->count];
+        nodes_push(out, x);
+        if (x->lhs) nodes_push(tmp, x->lhs);
+        if (x->rhs) nodes_push(tmp, x->rhs);
+    }
+    for (int i = 0, j = out->count - 1; i < j; i++, j--) {
+        Node *t = out->items[i];
+        out->items[i] = out->items[j];
+        out->items[j] = t;
+    }
+}
+
+static Node *new_node(Interp *in, NodeKind kind, Value value, int line, int col) {
+    Node *n = (Node *)arena_alloc(&in->ast_arena, sizeof(Node));
+    n->kind  = kind;
+    n->value = value;
+    n->line  = line;
+    n->col   = col;
+    n->lhs   = NULL;
+    n->rhs   = NULL;
+    return n;
+}
+
+/* ======================== PARSER ======================== */
+/*
+ * Statements are parsed by recursive descent and expressions by
+ * operator precedence (see parse_expr()); both follow the CFG exactly
+ * and build an AST for each statement.  Semantic checks
+ * (undeclared / redeclared variables) are made while parsing, and
+ * identifiers are resolved to their slots.
+ *
+ * Tokens are pulled from the lexer on demand through a small ring
+ * buffer of lookahead tokens, so the whole token stream is never held
+ * in memory.  A pointer returned by current_token() or advance() stays
+ * valid only until LOOKAHEAD more tokens have been read; anything the
+ * parser keeps across a sub-parse is copied.
+ * The context's `had_error` flag is set on the first error; once set,
+ * parsing continues to report as many errors as practical, but
+ * execution results are suppressed.
+ */
+
+/* Start parsing a new source buffer */
+static void parser_init(Interp *in, const char *src, size_t len) {
+    lex_init(in, src, len);
+    in->ring_head  = 0;
+    in->ring_count = 0;
+    in->had_error  = 0;
+    in->panic      = 0;
+    in->diag_count = 0;
+}
+
+/* Return the k-th upcoming token (0 = current), lexing as needed */
+static Token *peek_token(Interp *in, int k) {
+    while (in->ring_count <= k) {
+        Token *slot = &in->ring[(in->ring_head + in->ring_count) & (LOOKAHEAD - 1)];
+        if (next_token(in, slot) != 0) in->had_error = 1;
+        STAT_ADD(in, tokens, 1);
+        in->ring_count++;
+    }
+    return &in->ring[(in->ring_head + k) & (LOOKAHEAD - 1)];
+}
+
+/* Return the current token without consuming it */
+static Token *current_token(Interp *in) {
+    return peek_token(in, 0);
+}
+
+/* Consume the current token and advance */
+static Token *advance(Interp *in) {
+    Token *t = peek_token(in, 0);
+    if (t->type != TOK_EOF) {
+        in->ring_head = (in->ring_head + 1) & (LOOKAHEAD - 1);
+        in->ring_count--;
+    }
+    return t;
+}
+
+/* Check if the current token matches a given type */
+static int check(Interp *in, TokenType type) {
+    return current_token(in)->type == type;
+}
+
+/*
+ * Syntax errors use panic-mode recovery: the first one in a statement
+ * is reported and sets `panic`, which silences the rest of that
+ * statement's syntax errors.  The parser carries on without consuming
+ * the offending tokens, and parse_stmt() then calls synchronise() to
+ * skip to the start of the next statement.
+ */
+static void syntax_error(Interp *in, const Token *t, const char *expected) {
+    /* After a lexical error the stream ends early; don't pile on */
+    if (!in->lex_error && !in->panic) {
+        diag(in, DIAG_SYNTAX, t->line, t->col,
+            "expected %s but found %s ('%.*s')",
+            expected, token_type_name(t->type), t->length, lexeme(in, t));
+    }
+    in->had_error = 1;
+    in->panic     = 1;
+}
+
+/* Skip past the next ";", or up to an "int" or "print", and leave panic mode */
+static void synchronise(Interp *in) {
+    for (;;) {
+        TokenType type = current_token(in)->type;
+        if (type == TOK_INT || type == TOK_PRINT || type == TOK_EOF) break;
+        advance(in);
+        if (type == TOK_SEMICOLON) break;
+    }
+    in->panic = 0;
+}
+
+/*
+ * expect() - Consume the current token if it matches the expected type.
+ * On mismatch, report a syntax error and leave the token in place.
+ * Returns a pointer to the consumed token (or the mismatched one).
+ */
+static Token *expect(Interp *in, TokenType type) {
+    Token *t = current_token(in);
+    if (t->type == type) {
+        return advance(in);
+    }
+    syntax_error(in, t, token_type_name(type));
+    return t;
+}
+
+/*
+ * Factor -> INTEGER | IDENTIFIER
+ * (parse_expr() handles "(" Expr ")" itself.)  Erroneous factors are
+ * replaced by the literal 0, without consuming the token.
+ */
+static Node *parse_factor(Interp *in) {
+    Token *t = current_token(in);
+
+    /* INTEGER literal */
+    if (t->type == TOK_INTEGER) {
+        advance(in);
+        return new_node(in, N_NUM, t->value, t->line, t->col);
+    }
+
+    /* IDENTIFIER - resolve the variable to its slot */
+    if (t->type == TOK_IDENTIFIER) {
+        advance(in);
+        Variable *v = sym_lookup(in, t->value);
+        if (!v) {
+            diag(in, DIAG_SEMANTIC, t->line, t->col,
+                "undeclared variable '%s'", intern_name(in, t->value));
+            in->had_error = 1;
+            return new_node(in, N_NUM, 0, t->line, t->col);
+        }
+        return new_node(in, N_VAR, v->slot, t->line, t->col);
+    }
+
+    syntax_error(in, t, "expression");
+    return new_node(in, N_NUM, 0, t->line, t->col);
+}
+
+/*
+ * Expressions are parsed by operator precedence over two explicit,
+ * heap-allocated stacks instead of by recursion through Expr, Term and
+ * Factor, so nesting depth is limited only by memory.  Tokens are
+ * consumed and errors reported in exactly the order recursive descent
+ * over the CFG would, and the trees are the same: "*" and "/" bind
+ * tighter than "+" and "-", and both levels associate to the left.
+ */
+
+/* An operator waiting for its right operand, or an open parenthesis */
+typedef struct ExprOp {
+    NodeKind kind;  /* N_ADD .. N_DIV, or N_NUM for "(" */
+    int      line, col;
+} ExprOp;
+
+static int precedence(NodeKind kind) {
+    return kind == N_MUL || kind == N_DIV ? 2 : 1;
+}
+
+static void push_operand(Interp *in, Node *n) {
+    in->expr_nodes = (struct Node **)stack_reserve(in->expr_nodes, &in->expr_nodes_cap,
+                                                   in->expr_nnodes + 1, sizeof(Node *));
+    in->expr_nodes[in->expr_nnodes++] = n;
+}
+
+static void push_operator(Interp *in, NodeKind kind, int line, int col) {
+    in->expr_ops = (struct ExprOp *)stack_reserve(in->expr_ops, &in->expr_ops_cap,
+                                                  in->expr_nops + 1, sizeof(ExprOp));
+    ExprOp *op = &in->expr_ops[in->expr_nops++];
+    op->kind = kind;
+    op->line = line;
+    op->col  = col;
+}
+
+/* Is there an operator (not a "(") on top of the stack? */
+static int operator_on_top(const Interp *in) {
+    return in->expr_nops > 0 && in->expr_ops[in->expr_nops - 1].kind != N_NUM;
+}
+
+/* Apply the top operator to the top two operands */
+static void reduce(Interp *in) {
+    const ExprOp *op  = &in->expr_ops[--in->expr_nops];
+    Node         *rhs = in->expr_nodes[--in->expr_nnodes];
+    Node         *n   = new_node(in, op->kind, 0, op->line, op->col);
+    n->lhs = in->expr_nodes[in->expr_nnodes - 1];
+    n->rhs = rhs;
+    in->expr_nodes[in->expr_nnodes - 1] = n;
+}
+
+/*
+ * Expr   -> Term (( "+" | "-" ) Term)*
+ * Term   -> Factor (( "*" | "/" ) Factor)*
+ * Factor -> ... | "(" Expr ")"
+ */
+static Node *parse_expr(Interp *in) {
+    in->expr_nops   = 0;
+    in->expr_nnodes = 0;
+    STAT_DEPTH_ENTER(in);
+
+    for (;;) {
+        /* --- An operand: any number of "(", then a factor --- */
+        while (check(in, TOK_LPAREN)) {
+            const Token *t = advance(in);
+            push_operator(in, N_NUM, t->line, t->col);
+            STAT_DEPTH_ENTER(in);
+        }
+        push_operand(in, parse_factor(in));
+
+        /* --- Then operators, or the ends of (sub)expressions --- */
+        for (;;) {
+            const Token *t = current_token(in);
+            NodeKind     kind;
+            switch (t->type) {
+                case TOK_PLUS:  kind = N_ADD; break;
+                case TOK_MINUS: kind = N_SUB; break;
+                case TOK_STAR:  kind = N_MUL; break;
+                case TOK_SLASH: kind = N_DIV; break;
+                default:        kind = N_NUM; break;
+            }
+            if (kind != N_NUM) {
+                while (operator_on_top(in) &&
+                       precedence(in->expr_ops[in->expr_nops - 1].kind) >= precedence(kind))
+                    reduce(in);
+                push_operator(in, kind, t->line, t->col);
+                advance(in);
+                break;
+            }
+
+            while (operator_on_top(in)) reduce(in);
+            STAT_DEPTH_LEAVE(in);
+            if (in->expr_nops == 0) return in->expr_nodes[0];
+            in->expr_nops--;  /* the matching "(" */
+            expect(in, TOK_RPAREN);
+        }
+    }
+}
+
+/*
+ * Declaration -> "int" IDENTIFIER "=" Expr ";"
+ */
+static Stmt *parse_declaration(Interp *in) {
+    int   reported = in->diag_count;
+    Stmt *s = (Stmt *)arena_alloc(&in->ast_arena, sizeof(Stmt));
+    s->kind = S_DECL;
+    s->slot = -1;
+    s->next = NULL;
+
+    expect(in, TOK_INT);   /* consume "int" */
+
+    Token id = *expect(in, TOK_IDENTIFIER);
+
+    expect(in, TOK_ASSIGN); /* consume "=" */
+
+    s->expr = parse_expr(in);
+
+    expect(in, TOK_SEMICOLON); /* consume ";" */
+
+    /* Semantic action: declare the variable.  This is done whenever it
+       was named, even in a malformed statement or after other errors,
+       so that later uses are not all reported as undeclared.  In a
+       session, a declaration with errors is left out instead, so that
+       it can be corrected and sent again. */
+    if (id.type == TOK_IDENTIFIER && (!in->session || in->diag_count == reported)) {
+        Variable *v = sym_declare(in, id.value, id.line);
+        if (v) {
+            s->slot = v->slot;
+        } else {
+            in->had_error = 1; /* redeclaration error already printed */
+        }
+    }
+    return s;
+}
+
+/*
+ * PrintStmt -> "print" "(" Expr ")" ";"
+ */
+static Stmt *parse_print(Interp *in) {
+    Stmt *s = (Stmt *)arena_alloc(&in->ast_arena, sizeof(Stmt));
+    s->kind = S_PRINT;
+    s->slot = -1;
+    s->next = NULL;
+
+    expect(in, TOK_PRINT);  /* consume "print" */
+    expect(in, TOK_LPAREN); /* consume "("     */
+
+    s->expr = parse_expr(in);
+
+    expect(in, TOK_RPAREN);    /* consume ")" */
+    expect(in, TOK_SEMICOLON); /* consume ";" */
+    return s;
+}
+
+/*
+ * Stmt -> Declaration | PrintStmt
+ * Returns NULL if no statement could be parsed.
+ */
+static Stmt *parse_stmt(Interp *in) {
+    Token *t = current_token(in);
+    Stmt  *s = NULL;
+
+    if (t->type == TOK_INT)
+        s = parse_declaration(in);
+    else if (t->type == TOK_PRINT)
+        s = parse_print(in);
+    else
+        syntax_error(in, t, "'int' or 'print' at start of statement");
+
+    if (in->panic) synchronise(in);
+    return s;
+}
+
+/* ======================== OUTPUT ======================== */
+/*
+ * print() results are formatted by hand into a large buffer that is
+ * written out in blocks (and at the end of the run) instead of going
+ * through printf() for every statement.  With --binary-output each
+ * value is written as a raw int32 in native byte order, no newline.
+ */
+
+/* "00" "01" ... "99": two decimal digits per lookup */
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/* Hand the buffered output to the callback or the output stream */
+static void output_drain(Interp *in) {
+    if (in->out_len > 0) {
+        if (in->out_fn)
+            in->out_fn(in->out_user, in->out_buf, in->out_len);
+        else
+            fwrite(in->out_buf, 1, in->out_len, in->out_fp);
+    }
+    in->out_len = 0;
+}
+
+static void output_flush(Interp *in) {
+    output_drain(in);
+    if (!in->out_fn) fflush(in->out_fp);
+}
+
+/* Write v in decimal ending just before end; returns the first char */
+static char *format_int(char *end, Value v) {
+    UValue u = v < 0 ? 0u - (UValue)v : (UValue)v;
+    char *p = end;
+    while (u >= 100) {
+        unsigned r = (unsigned)(u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[r + 1];
+        *--p = digit_pairs[r];
+    }
+    if (u >= 10) {
+        *--p = digit_pairs[u * 2 + 1];
+        *--p = digit_pairs[u * 2];
+    } else {
+        *--p = (char)('0' + u);
+    }
+    if (v < 0) *--p = '-';
+    return p;
+}
+
+/* Emit the result of one print() statement */
+static void output_value(Interp *in, Value v) {
+    STAT_ADD(in, prints, 1);
+    if (OUT_BUF_SIZE - in->out_len < 32) output_drain(in);
+    if (in->opt.out_binary) {
+        memcpy(in->out_buf + in->out_len, &v, sizeof(v));
+        in->out_len += sizeof(v);
+        return;
+    }
+    char  tmp[24];
+    char *start = format_int(tmp + sizeof(tmp) - 1, v);
+    tmp[sizeof(tmp) - 1] = '\n';
+    size_t n = (size_t)(tmp + sizeof(tmp) - start);
+    memcpy(in->out_buf + in->out_len, start, n);
+    in->out_len += n;
+}
+
+/* ======================== EXECUTION ======================== */
+/*
+ * Evaluates ASTs against slot_values[].  A division by zero is reported
+ * at the '/' operator and yields 0; once any error has been seen,
+ * declarations still run but print() output is suppressed.
+ *
+ * Arithmetic wraps around on overflow (two's complement), including
+ * VALUE_MIN / -1, so every engine and the constant folder agree.  With
+ * the `checked` option an overflow is instead reported like a division
+ * by zero, at the operator, and yields 0.
+ */
+
+static Value arith_add(Value a, Value b) { return (Value)((UValue)a + (UValue)b); }
+static Value arith_sub(Value a, Value b) { return (Value)((UValue)a - (UValue)b); }
+static Value arith_mul(Value a, Value b) { return (Value)((UValue)a * (UValue)b); }
+
+/* b must be non-zero */
+static Value arith_div(Value a, Value b) {
+    return b == -1 ? (Value)(0u - (UValue)a) : a / b;
+}
+
+/*
+ * Overflow-checked a <kind> b using the compiler's overflow builtins.
+ * Returns 0 and stores the result, or -1 if it does not fit in a Value.
+ * For N_DIV, b must be non-zero.
+ */
+static int arith_checked(NodeKind kind, Value a, Value b, Value *r) {
+    switch (kind) {
+        case N_ADD: return __builtin_add_overflow(a, b, r) ? -1 : 0;
+        case N_SUB: return __builtin_sub_overflow(a, b, r) ? -1 : 0;
+        case N_MUL: return __builtin_mul_overflow(a, b, r) ? -1 : 0;
+        case N_DIV:
+            if (a == VALUE_MIN && b == -1) return -1;
+            *r = a / b;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static void report_overflow(Interp *in, int line, int col) {
+    diag(in, DIAG_RUNTIME, line, col, "integer overflow");
+    in->had_error = 1;
+}
+
+/* n's operator applied to already evaluated operands */
+static Value eval_binary(Interp *in, const Node *n, Value left, Value right) {
+    if (n->kind == N_DIV && right == 0) {
+        diag(in, DIAG_RUNTIME, n->line, n->col, "division by zero");
+        in->had_error = 1;
+        return 0;
+    }
+    if (in->opt.checked) {
+        Value r;
+        if (arith_checked(n->kind, left, right, &r) == 0) return r;
+        report_overflow(in, n->line, n->col);
+        return 0;
+    }
+    switch (n->kind) {
+        case N_ADD: return arith_add(left, right);
+        case N_SUB: return arith_sub(left, right);
+        case N_MUL: return arith_mul(left, right);
+        default:    return arith_div(left, right);
+    }
+}
+
+/*
+ * Expressions are evaluated by recursion up to EVAL_MAX_DEPTH, which
+ * is as fast as it gets; subtrees deeper than that are handed to
+ * eval_deep(), which walks them with explicit stacks so that a deep
+ * tree cannot overflow the C stack.
+ */
+#define EVAL_MAX_DEPTH 256
+
+/* eval_deep() pushes a node twice: first to schedule its operands (lhs
+   runs first), then, marked done, to combine their values */
+typedef struct EvalFrame {
+    const Node *n;
+    int         done;
+} EvalFrame;
+
+static Value eval_deep(Interp *in, const Node *root) {
+    /* Every value on the stack but the last waits for a done frame, so
+       reserving frames with room for one more value suffices */
+    int nframes = 0, nvalues = 0;
+    in->eval_frames = (EvalFrame *)stack_reserve(in->eval_frames, &in->eval_frames_cap,
+                                                 1, sizeof(EvalFrame));
+    in->eval_values = (Value *)stack_reserve(in->eval_values, &in->eval_values_cap,
+                                             2, sizeof(Value));
+    in->eval_frames[nframes++] = (EvalFrame){ root, 0 };
+
+    while (nframes > 0) {
+        EvalFrame   f = in->eval_frames[--nframes];
+        const Node *n = f.n;
+
+        if (n->kind == N_NUM) {
+            in->eval_values[nvalues++] = n->value;
+        } else if (n->kind == N_VAR) {
+            in->eval_values[nvalues++] = in->slot_values[n->value];
+        } else if (f.done) {
+            Value *top = &in->eval_values[nvalues - 1];
+            if (n->kind == N_SAVE) {
+                in->slot_values[n->value] = *top;
+            } else {
+                top[-1] = eval_binary(in, n, top[-1], top[0]);
+                nvalues--;
+            }
+        } else {
+            in->eval_frames = (EvalFrame *)stack_reserve(in->eval_frames, &in->eval_frames_cap,
+                                                         nframes + 3, sizeof(EvalFrame));
+            in->eval_values = (Value *)stack_reserve(in->eval_values, &in->eval_values_cap,
+                                                     nframes + 4, sizeof(Value));
+            EvalFrame *fr = in->eval_frames;
+            fr[nframes++] = (EvalFrame){ n, 1 };
+            if (n->rhs) fr[nframes++] = (EvalFrame){ n->rhs, 0 };
+            fr[nframes++] = (EvalFrame){ n->lhs, 0 };
+        }
+    }
+    return in->eval_values[0];
+}
+
+static Value eval_node(Interp *in, const Node *n, int depth) {
+    if (depth > EVAL_MAX_DEPTH) return eval_deep(in, n);
+
+    switch (n->kind) {
+        case N_NUM: return n->value;
+        case N_VAR: return in->slot_values[n->value];
+        case N_ADD:
+        case N_SUB:
+        case N_MUL:
+        case N_DIV: {
+            Value left = eval_node(in, n->lhs, depth + 1);
+            return eval_binary(in, n, left, eval_node(in, n->rhs, depth + 1));
+        }
+        case N_SAVE:
+            return in->slot_values[n->value] = eval_node(in, n->lhs, depth + 1);
+    }
+    return 0;
+}
+
+static Value eval_expr(Interp *in, const Node *n) {
+    return eval_node(in, n, 0);
+}
+
+static void exec_stmt(Interp *in, const Stmt *s) {
+    Value value = eval_expr(in, s->expr);
+
+    if (s->kind == S_DECL) {
+        if (s->slot >= 0) in->slot_values[s->slot] = value;
+    } else if (!in->had_error) {
+        output_value(in, value);
+    }
+}
+
+/* Execute a parsed program from start to end */
+static void exec_program(Interp *in, const Program *prog) {
+    for (const Stmt *s = prog->first; s; s = s->next)
+        exec_stmt(in, s);
+}
+
+/* ======================== DEPENDENCY GRAPH ======================== */
+/*
+ * Every slot has exactly one writer, either a declaration or an
+ * optimiser temporary (N_SAVE), and is only read by later statements.
+ * So the statements of an error-free Program form a DAG: statement i
+ * depends on the writers of the slots it reads.  depgraph_build()
+ * records, for each statement, how many statements it depends on and
+ * which statements depend on it.
+ */
+
+typedef struct {
+    Stmt **stmts;     /* statements in source order                   */
+    int    n;
+    int   *npending;  /* per statement: statements it depends on      */
+    int   *dep_start; /* dependents of i: deps[dep_start[i] .. dep_start[i + 1]) */
+    int   *deps;
+    int   *decl_of;   /* per slot: statement declaring it, or -1      */
+} DepGraph;
+
+/* Edges from statement `from` to a statement `to` that reads it */
+typedef struct {
+    int *from, *to;
+    int  count, cap;
+} DepEdges;
+
+static void dep_edge(DepEdges *e, int from, int to) {
+    if (e->count == e->cap) {
+        e->cap  = e->cap ? e->cap * 2 : 1024;
+        e->from = (int *)xrealloc(e->from, e->cap * sizeof(int));
+        e->to   = (int *)xrealloc(e->to, e->cap * sizeof(int));
+    }
+    e->from[e->count] = from;
+    e->to[e->count]   = to;
+    e->count++;
+}
+
+/*
+ * Collect the dependencies of statement i, whose nodes are listed in
+ * evaluation order, on earlier statements.  writer[slot] is the
+ * statement that stores the slot; seen[] keeps each dependency from
+ * being counted twice.
+ */
+static void dep_scan(const NodeList *order, int i, int *writer, int *seen, DepEdges *e,
+                     int *npending) {
+    for (int k = 0; k < order->count; k++) {
+        const Node *n = order->items[k];
+        if (n->kind == N_VAR) {
+            int w = writer[n->value];
+            if (w >= 0 && w != i && seen[w] != i) {
+                seen[w] = i;
+                dep_edge(e, w, i);
+                (*npending)++;
+            }
+        } else if (n->kind == N_SAVE) {
+            writer[n->value] = i;
+        }
+    }
+}
+
+static void depgraph_build(DepGraph *g, const Program *prog) {
+    int n = prog->stmt_count;
+    g->n        = n;
+    g->stmts    = (Stmt **)xmalloc((n + 1) * sizeof(Stmt *));
+    g->npending = (int *)xmalloc((n + 1) * sizeof(int));
+    g->decl_of  = (int *)xmalloc((prog->slot_count + 1) * sizeof(int));
+
+    int     *writer = (int *)xmalloc((prog->slot_count + 1) * sizeof(int));
+    int     *seen   = (int *)xmalloc((n + 1) * sizeof(int));
+    DepEdges edges  = { NULL, NULL, 0, 0 };
+    NodeList order  = { NULL, 0, 0 }, tmp = { NULL, 0, 0 };
+    for (int s = 0; s < prog->slot_count; s++) writer[s] = g->decl_of[s] = -1;
+
+    int i = 0;
+    for (Stmt *s = prog->first; s; s = s->next, i++) {
+        g->stmts[i]    = s;
+        g->npending[i] = 0;
+        seen[i]        = -1;
+        nodes_postorder(&order, &tmp, s->expr);
+        dep_scan(&order, i, writer, seen, &edges, &g->npending[i]);
+        if (s->kind == S_DECL) writer[s->slot] = g->decl_of[s->slot] = i;
+    }
+
+    /* Group the edges by source */
+    g->dep_start = (int *)xmalloc((n + 1) * sizeof(int));
+    g->deps      = (int *)xmalloc((edges.count + 1) * sizeof(int));
+    memset(g->dep_start, 0, (n + 1) * sizeof(int));
+    for (int k = 0; k < edges.count; k++) g->dep_start[edges.from[k] + 1]++;
+    for (int k = 0; k < n; k++) g->dep_start[k + 1] += g->dep_start[k];
+    memcpy(seen, g->dep_start, n * sizeof(int));  /* reuse as fill cursor */
+    for (int k = 0; k < edges.count; k++) g->deps[seen[edges.from[k]]++] = edges.to[k];
+
+    free(edges.from);
+    free(edges.to);
+    free(order.items);
+    free(tmp.items);
+    free(writer);
+    free(seen);
+}
+
+static void depgraph_free(DepGraph *g) {
+    free(g->stmts);
+    free(g->npending);
+    free(g->dep_start);
+    free(g->deps);
+    free(g->decl_of);
+}
+
+/* ======================== PARALLEL EXECUTION ======================== */
+/*
+ * exec_parallel() runs an error-free Program on a pool of threads
+ * (--engine=parallel).  A statement can run as soon as the statements
+ * it depends on (see DEPENDENCY GRAPH) have finished.
+ *
+ * Each thread has a Chase-Lev work-stealing deque.  A thread that
+ * finishes a statement pushes the dependents it made ready onto its own
+ * deque and takes them LIFO.  Idle threads steal the oldest entries
+ * from the others.  Runtime errors and print() values are recorded per
+ * statement and emitted afterwards in source order, so the output is
+ * exactly that of exec_program().
+ */
+
+#define PAR_MIN_STMTS 256   /* smaller programs run serially */
+
+#if HAVE_PTHREADS
+
+/* A runtime diagnostic recorded while a statement ran */
+typedef struct {
+    int      stmt;
+    int      seq;      /* order within the recording thread */
+    DiagKind kind;
+    int      line, col;
+    char    *msg;
+} ParDiag;
+
+/* Fixed-size Chase-Lev deque of statement indexes */
+typedef struct {
+    _Atomic long top;
+    _Atomic long bottom;
+    _Atomic int *items;
+    long         mask;   /* capacity - 1; capacity >= statement count */
+} WsDeque;
+
+typedef struct ParExec ParExec;
+
+typedef struct {
+    ParExec *px;
+    WsDeque  dq;
+    Interp  *w;          /* scratch context the statements run in */
+    ParDiag *diags;
+    int      ndiags, cap;
+    int      cur_stmt;
+    unsigned rng;        /* victim selection */
+} ParWorker;
+
+struct ParExec {
+    Stmt       **stmts;
+    int          n;
+    Value       *results;   /* print() values, by statement    */
+    _Atomic int *pending;   /* unfinished dependencies          */
+    int         *dep_start; /* dependents of i: deps[dep_start[i] .. dep_start[i+1]) */
+    int         *deps;
+    _Atomic int  done;      /* statements finished              */
+    ParWorker   *workers;
+    int          nworkers;
+};
+
+static void ws_push(WsDeque *q, int item) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    atomic_store_explicit(&q->items[b & q->mask], item, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+}
+
+/* Owner end; returns -1 if empty */
+static int ws_take(WsDeque *q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return -1;
+    }
+    int item = atomic_load_explicit(&q->items[b & q->mask], memory_order_relaxed);
+    if (t == b) {
+        /* Last entry: race any thief for it */
+        if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+            item = -1;
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+/* Thief end; returns -1 if empty or lost a race */
+static int ws_steal(WsDeque *q) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return -1;
+
+    int item = atomic_load_explicit(&q->items[t & q->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+        return -1;
+    return item;
+}
+
+/* Diagnostics from a worker's scratch context are kept for later */
+static void par_capture(void *user, DiagKind kind, int line, int col, const char *msg) {
+    ParWorker *me = (ParWorker *)user;
+    if (me->ndiags == me->cap) {
+        me->cap   = me->cap ? me->cap * 2 : 16;
+        me->diags = (ParDiag *)xrealloc(me->diags, me->cap * sizeof(ParDiag));
+    }
+    ParDiag *d = &me->diags[me->ndiags];
+    d->stmt = me->cur_stmt;
+    d->seq  = me->ndiags++;
+    d->kind = kind;
+    d->line = line;
+    d->col  = col;
+    d->msg  = (char *)xmalloc(strlen(msg) + 1);
+    strcpy(d->msg, msg);
+}
+
+/* Run statement i, then release the statements waiting for it */
+static void par_run(ParWorker *me, int i) {
+    ParExec    *px = me->px;
+    const Stmt *s  = px->stmts[i];
+
+    me->cur_stmt = i;
+    Value v = eval_expr(me->w, s->expr);
+    if (s->kind == S_DECL)
+        me->w->slot_values[s->slot] = v;
+    else
+        px->results[i] = v;
+
+    for (int k = px->dep_start[i]; k < px->dep_start[i + 1]; k++) {
+        int d = px->deps[k];
+        if (atomic_fetch_sub_explicit(&px->pending[d], 1, memory_order_acq_rel) == 1)
+            ws_push(&me->dq, d);
+    }
+    atomic_fetch_add_explicit(&px->done, 1, memory_order_release);
+}
+
+static void *par_worker(void *arg) {
+    ParWorker *me = (ParWorker *)arg;
+    ParExec   *px = me->px;
+
+    while (atomic_load_explicit(&px->done, memory_order_acquire) < px->n) {
+        int i = ws_take(&me->dq);
+        for (int tries = 0; i < 0 && tries < px->nworkers; tries++) {
+            me->rng = me->rng * 1103515245u + 12345u;
+            ParWorker *victim = &px->workers[(me->rng >> 16) % px->nworkers];
+            if (victim != me) i = ws_steal(&victim->dq);
+        }
+        if (i < 0) {
+            sched_yield();
+            continue;
+        }
+        par_run(me, i);
+    }
+    return NULL;
+}
+
+static int par_diag_cmp(const void *a, const void *b) {
+    const ParDiag *x = (const ParDiag *)a, *y = (const ParDiag *)b;
+    if (x->stmt != y->stmt) return x->stmt < y->stmt ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void exec_parallel(Interp *in, const Program *prog) {
+    int threads = in->opt.exec_threads;
+    int n       = prog->stmt_count;
+    if (threads < 2 || n < PAR_MIN_STMTS) {
+        exec_program(in, prog);
+        return;
+    }
+
+    ParExec px;
+    memset(&px, 0, sizeof(px));
+    px.n       = n;
+    px.results = (Value *)xmalloc(n * sizeof(Value));
+    px.pending = (_Atomic int *)xmalloc(n * sizeof(_Atomic int));
+
+    DepGraph g;
+    depgraph_build(&g, prog);
+    px.stmts     = g.stmts;
+    px.dep_start = g.dep_start;
+    px.deps      = g.deps;
+    for (int i = 0; i < n; i++) atomic_init(&px.pending[i], g.npending[i]);
+
+    /* --- Start the pool; the calling thread is worker 0 --- */
+    long cap = 1;
+    while (cap < n) cap *= 2;
+    px.nworkers = threads;
+    px.workers  = (ParWorker *)xmalloc(threads * sizeof(ParWorker));
+    memset(px.workers, 0, threads * sizeof(ParWorker));
+    atomic_init(&px.done, 0);
+    for (int t = 0; t < threads; t++) {
+        ParWorker *me = &px.workers[t];
+        me->px      = &px;
+        me->rng     = 2654435761u * (unsigned)(t + 1);
+        me->dq.mask = cap - 1;
+        me->dq.items = (_Atomic int *)xmalloc(cap * sizeof(_Atomic int));
+        atomic_init(&me->dq.top, 0);
+        atomic_init(&me->dq.bottom, 0);
+        me->w = (Interp *)xmalloc(sizeof(Interp));
+        interp_init(me->w, NULL, NULL);
+        me->w->opt         = in->opt;
+        me->w->opt.max_errors = 0;            /* counted when replayed */
+        me->w->slot_values = in->slot_values;  /* shared; see par_run() */
+        me->w->diag_fn     = par_capture;
+        me->w->diag_user   = me;
+    }
+    for (int k = 0, t = 0; k < n; k++) {
+        if (atomic_load_explicit(&px.pending[k], memory_order_relaxed) == 0) {
+            ws_push(&px.workers[t].dq, k);
+            t = (t + 1) % threads;
+        }
+    }
+
+    /* If a thread fails to start, the others steal its deque empty */
+    pthread_t *tids    = (pthread_t *)xmalloc(threads * sizeof(pthread_t));
+    int        started = 1;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, par_worker, &px.workers[t]) != 0) break;
+        started++;
+    }
+    par_worker(&px.workers[0]);
+    for (int t = 1; t < started; t++) pthread_join(tids[t], NULL);
+    free(tids);
+
+    /* --- Emit diagnostics and output in source order --- */
+    int total = 0;
+    for (int t = 0; t < threads; t++) total += px.workers[t].ndiags;
+    ParDiag *all = (ParDiag *)xmalloc((total + 1) * sizeof(ParDiag));
+    total = 0;
+    for (int t = 0; t < threads; t++) {
+        if (px.workers[t].ndiags == 0) continue;  /* diags may be NULL */
+        memcpy(all + total, px.workers[t].diags, px.workers[t].ndiags * sizeof(ParDiag));
+        total += px.workers[t].ndiags;
+    }
+    qsort(all, total, sizeof(ParDiag), par_diag_cmp);
+
+    int d = 0;
+    for (int k = 0; k < n; k++) {
+        for (; d < total && all[d].stmt == k; d++) {
+            diag(in, all[d].kind, all[d].line, all[d].col, "%s", all[d].msg);
+            in->had_error = 1;
+        }
+        if (px.stmts[k]->kind == S_PRINT && !in->had_error)
+            output_value(in, px.results[k]);
+    }
+
+    for (int k = 0; k < total; k++) free(all[k].msg);
+    free(all);
+    for (int t = 0; t < threads; t++) {
+        ParWorker *me = &px.workers[t];
+        me->w->slot_values = NULL;
+        interp_release(me->w);
+        free(me->w);
+        free(me->diags);
+        free((void *)me->dq.items);
+    }
+    free(px.workers);
+    free(px.results);
+    free((void *)px.pending);
+    depgraph_free(&g);
+}
+
+#else /* no threads */
+
+static void exec_parallel(Interp *in, const Program *prog) {
+    exec_program(in, prog);
+}
+
+#endif /* HAVE_PTHREADS */
+
+/* ======================== OPTIMISER ======================== */
+/*
+ * optimise_program() rewrites an error-free Program in place before it
+ * is executed:
+ *
+ *   1. Constant folding.  Operators whose operands are both literals
+ *      are replaced by their result.  A division by a divisor that
+ *      folds to 0 is left alone, so it is reported as a Runtime Error
+ *      when the statement runs, as the direct engine reports it; only
+ *      --check, which runs nothing, reports it here.  Likewise with
+ *      checked arithmetic an operator that would overflow is left
+ *      alone, so the overflow is reported when the statement runs.
+ *
+ *   2. Common-subexpression elimination.  Every operator node gets a
+ *      value number from (operator, operand value numbers); ADD and MUL
+ *      operands are ordered so a*b and b*a match.  A variable is
+ *      assigned exactly once (redeclaration is an error), so equal
+ *      value numbers mean equal values anywhere in the program.  The
+ *      first evaluation of a repeated expression is wrapped in N_SAVE,
+ *      which stores it in a fresh temporary slot, and later copies
+ *      become plain loads of that slot.  Expressions containing a
+ *      division by a non-constant or by 0 are left alone, so every
+ *      division that can fail is still evaluated and reported.  With checked
+ *      arithmetic every operator can fail, so this pass is skipped.
+ */
+
+typedef struct {
+    int   kind;  /* key: node kind and operand value numbers,  */
+    Value a, b;  /* or a literal's value                         */
+    int   vn;    /* value number, or -1 for an empty entry       */
+} VnEntry;
+
+struct Cse {
+    VnEntry *table;      /* open-addressing (kind, a, b) -> vn      */
+    unsigned mask;
+    int      used;
+    int     *count;      /* per vn: operator nodes with that number */
+    int     *temp;       /* per vn: temporary holding it, or -1     */
+    int      vn_count;
+    int      vn_cap;
+    int      first_temp; /* slot of temporary 0                     */
+    int      temp_count;
+    int     *uses;       /* per temporary: loads that read it       */
+    int      uses_cap;
+    int     *remap;      /* per temporary: final temporary index    */
+    int      remap_cap;
+    int     *vn_stack;   /* cse_number()'s operand numbers          */
+    int      vn_stack_cap;
+};
+
+static int is_binary(NodeKind k) {
+    return k == N_ADD || k == N_SUB || k == N_MUL || k == N_DIV;
+}
+
+/* Allocate a new value number */
+static int vn_new(Cse *c) {
+    if (c->vn_count == c->vn_cap) {
+        c->vn_cap = c->vn_cap ? c->vn_cap * 2 : 256;
+        c->count = (int *)xrealloc(c->count, c->vn_cap * sizeof(int));
+        c->temp  = (int *)xrealloc(c->temp,  c->vn_cap * sizeof(int));
+    }
+    c->count[c->vn_count] = 0;
+    c->temp[c->vn_count]  = -1;
+    return c->vn_count++;
+}
+
+static unsigned vn_hash(int kind, Value a, Value b) {
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    unsigned h = (unsigned)kind * 0x9E3779B1u;
+    h = (h ^ (unsigned)ua ^ (unsigned)(ua >> 32)) * 0x85EBCA77u;
+    h = (h ^ (unsigned)ub ^ (unsigned)(ub >> 32)) * 0xC2B2AE3Du;
+    return h ^ (h >> 16);
+}
+
+/* Value number of the key (kind, a, b), numbering it if it is new */
+static int vn_lookup(Cse *c, int kind, Value a, Value b) {
+    if ((unsigned)(c->used + 1) * 2 > c->mask + 1 || !c->table) {
+        VnEntry *old      = c->table;
+        unsigned old_size = old ? c->mask + 1 : 0;
+        unsigned size     = old_size ? old_size * 2 : 1024;
+        c->table = (VnEntry *)xmalloc(size * sizeof(VnEntry));
+        c->mask  = size - 1;
+        for (unsigned i = 0; i < size; i++) c->table[i].vn = -1;
+        for (unsigned i = 0; i < old_size; i++) {
+            if (old[i].vn < 0) continue;
+            unsigned h = vn_hash(old[i].kind, old[i].a, old[i].b) & c->mask;
+            while (c->table[h].vn != -1) h = (h + 1) & c->mask;
+            c->table[h] = old[i];
+        }
+        free(old);
+    }
+
+    unsigned h = vn_hash(kind, a, b) & c->mask;
+    while (c->table[h].vn != -1) {
+        VnEntry *e = &c->table[h];
+        if (e->kind == kind && e->a == a && e->b == b) return e->vn;
+        h = (h + 1) & c->mask;
+    }
+    c->table[h].kind = kind;
+    c->table[h].a    = a;
+    c->table[h].b    = b;
+    c->table[h].vn   = vn_new(c);
+    c->used++;
+    return c->table[h].vn;
+}
+
+/* Pass 1: fold constants bottom-up */
+static void fold_node(Interp *in, Node *n) {
+    if (!is_binary(n->kind)) return;
+
+    if (n->kind == N_DIV && n->rhs->kind == N_NUM && n->rhs->value == 0) {
+        /* Left in place to fail when it runs, unless nothing will run */
+        if (in->opt.check_only) {
+            diag(in, DIAG_RUNTIME, n->line, n->col, "division by zero");
+            in->had_error = 1;
+        }
+        return;
+    }
+    if (n->lhs->kind != N_NUM || n->rhs->kind != N_NUM) return;
+
+    Value l = n->lhs->value, r = n->rhs->value;
+    if (in->opt.checked) {
+        /* An overflow is left in place to be reported when it runs */
+        Value v;
+        if (arith_checked(n->kind, l, r, &v) != 0) return;
+        n->value = v;
+        n->kind  = N_NUM;
+        n->lhs   = n->rhs = NULL;
+        return;
+    }
+    switch (n->kind) {
+        case N_ADD: n->value = arith_add(l, r); break;
+        case N_SUB: n->value = arith_sub(l, r); break;
+        case N_MUL: n->value = arith_mul(l, r); break;
+        case N_DIV: n->value = arith_div(l, r); break;
+        default: return;
+    }
+    n->kind = N_NUM;
+    n->lhs  = n->rhs = NULL;
+}
+
+/*
+ * Pass 2: number every node bottom-up and count operator nodes per
+ * number.  An operator node keeps its number in n->value.
+ */
+static void cse_number(Cse *c, const NodeList *order) {
+    int top = 0;  /* value numbers of the pending operands */
+    for (int k = 0; k < order->count; k++) {
+        Node *n = order->items[k];
+        c->vn_stack = (int *)stack_reserve(c->vn_stack, &c->vn_stack_cap, top + 1, sizeof(int));
+        if (!is_binary(n->kind)) {
+            c->vn_stack[top++] = vn_lookup(c, n->kind, n->value, 0);
+            continue;
+        }
+
+        int b = c->vn_stack[--top];
+        int a = c->vn_stack[--top];
+        if (n->kind == N_DIV && (n->rhs->kind != N_NUM || n->rhs->value == 0)) {
+            n->value = vn_new(c); /* may fail: never shared */
+        } else {
+            if ((n->kind == N_ADD || n->kind == N_MUL) && a > b) {
+                int t = a; a = b; b = t;
+            }
+            n->value = vn_lookup(c, n->kind, a, b);
+            c->count[n->value]++;
+        }
+        c->vn_stack[top++] = (int)n->value;
+    }
+}
+
+/*
+ * Pass 3: walk in evaluation order.  The first node of a repeated
+ * number becomes an N_SAVE into a new temporary; later ones become loads
+ * of it, and their subtrees are dropped unvisited.
+ */
+static void cse_rewrite(Interp *in, Cse *c, NodeList *stack, Node *root) {
+    stack->count = 0;
+    nodes_push(stack, root);
+    while (stack->count > 0) {
+        Node *n = stack->items[--stack->count];
+        if (!is_binary(n->kind)) continue;
+
+        int vn = n->value;
+        if (c->count[vn] >= 2) {
+            if (c->temp[vn] >= 0) {
+                n->kind  = N_VAR;
+                n->value = c->first_temp + c->temp[vn];
+                n->lhs   = n->rhs = NULL;
+                continue;
+            }
+            c->temp[vn] = c->temp_count++;
+
+            Node *inner = (Node *)arena_alloc(&in->ast_arena, sizeof(Node));
+            *inner   = *n;
+            n->kind  = N_SAVE;
+            n->value = c->first_temp + c->temp[vn];
+            n->lhs   = inner;
+            n->rhs   = NULL;
+            n = inner;
+        }
+        nodes_push(stack, n->rhs);  /* lhs is visited first */
+        nodes_push(stack, n->lhs);
+    }
+}
+
+/* Pass 4a: count the loads of each temporary */
+static void cse_count_uses(Cse *c, NodeList *stack, Node *root) {
+    stack->count = 0;
+    nodes_push(stack, root);
+    while (stack->count > 0) {
+        Node *n = stack->items[--stack->count];
+        if (n->kind == N_VAR && n->value >= c->first_temp)
+            c->uses[n->value - c->first_temp]++;
+        if (n->lhs) nodes_push(stack, n->lhs);
+        if (n->rhs) nodes_push(stack, n->rhs);
+    }
+}
+
+/*
+ * Pass 4b: a temporary whose later copies all sat inside larger shared
+ * expressions is never read: unwrap its N_SAVE.  The surviving
+ * temporaries are renumbered densely.
+ */
+static void cse_compact(Cse *c, NodeList *stack, Node *root) {
+    stack->count = 0;
+    nodes_push(stack, root);
+    while (stack->count > 0) {
+        Node *n = stack->items[--stack->count];
+        while (n->kind == N_SAVE && c->uses[n->value - c->first_temp] == 0)
+            *n = *n->lhs;
+        if (n->kind == N_SAVE || (n->kind == N_VAR && n->value >= c->first_temp))
+            n->value = c->first_temp + c->remap[n->value - c->first_temp];
+        if (n->lhs) nodes_push(stack, n->lhs);
+        if (n->rhs) nodes_push(stack, n->rhs);
+    }
+}
+
+/* Pass 1 over one statement, operands before their operators */
+static void fold_stmt(Interp *in, Stmt *s, NodeList *order, NodeList *tmp) {
+    nodes_postorder(order, tmp, s->expr);
+    for (int k = 0; k < order->count; k++) fold_node(in, order->items[k]);
+}
+
+static void fold_program(Interp *in, Program *prog) {
+    for (Stmt *s = prog->first; s; s = s->next)
+        fold_stmt(in, s, &in->walk, &in->walk_tmp);
+}
+
+static void optimise_program(Interp *in, Program *prog) {
+    fold_program(in, prog);
+    if (in->had_error) return;
+
+    /* With checked arithmetic any operator can fail, and every failure
+       must still be reported, so nothing may be shared */
+    if (in->opt.checked) return;
+
+    /* The tables of the last run are emptied, keeping their storage */
+    if (!in->cse) {
+        in->cse = (Cse *)xmalloc(sizeof(Cse));
+        memset(in->cse, 0, sizeof(Cse));
+    }
+    Cse      *c     = in->cse;
+    NodeList *order = &in->walk, *tmp = &in->walk_tmp;
+    for (unsigned i = 0; c->table && i <= c->mask; i++) c->table[i].vn = -1;
+    c->used       = 0;
+    c->vn_count   = 0;
+    c->temp_count = 0;
+    c->first_temp = prog->slot_count;
+
+    for (Stmt *s = prog->first; s; s = s->next) {
+        nodes_postorder(order, tmp, s->expr);
+        cse_number(c, order);
+    }
+    for (Stmt *s = prog->first; s; s = s->next)
+        cse_rewrite(in, c, tmp, s->expr);
+
+    if (c->temp_count > 0) {
+        c->uses  = (int *)stack_reserve(c->uses, &c->uses_cap, c->temp_count, sizeof(int));
+        c->remap = (int *)stack_reserve(c->remap, &c->remap_cap, c->temp_count, sizeof(int));
+        memset(c->uses, 0, c->temp_count * sizeof(int));
+        for (Stmt *s = prog->first; s; s = s->next)
+            cse_count_uses(c, tmp, s->expr);
+
+        int live = 0;
+        for (int t = 0; t < c->temp_count; t++)
+            c->remap[t] = c->uses[t] ? live++ : -1;
+        for (Stmt *s = prog->first; s; s = s->next)
+            cse_compact(c, tmp, s->expr);
+        prog->slot_count += live;
+    }
+}
+
+static void cse_free(Cse *c) {
+    if (!c) return;
+    free(c->vn_stack);
+    free(c->table);
+    free(c->count);
+    free(c->temp);
+    free(c->uses);
+    free(c->remap);
+    free(c);
+}
+
+/* ======================== BYTECODE COMPILER ======================== */
+/*
+ * compile_program() flattens a parsed Program into a linear array of
+ * stack-machine instructions.  Literals live in a constant pool and the
+ * source position of every '/' in a location table, so instructions are
+ * fixed-size (opcode, operand) pairs with no pointers in them.
+ */
+
+typedef enum {
+    OP_PUSH,  /* push consts[arg]                        */
+    OP_LOAD,  /* push slot_values[arg]                   */
+    OP_STORE, /* pop into slot_values[arg]               */
+    OP_TEE,   /* copy top of stack into slot_values[arg] */
+    OP_ADD,   /* pop b, pop a, push a + b                */
+    OP_SUB,   /* pop b, pop a, push a - b                */
+    OP_MUL,   /* pop b, pop a, push a * b                */
+    OP_DIV,   /* pop b, pop a, push a / b; arg = locs[]  */
+    OP_ADDC,  /* OP_ADD etc. reporting overflow at      */
+    OP_SUBC,  /*   locs[arg]; only in checked programs   */
+    OP_MULC,
+    OP_DIVC,
+    OP_PRINT, /* pop and print                           */
+    OP_HALT   /* end of program                          */
+} OpCode;
+
+typedef struct {
+    int op;  /* OpCode                */
+    int arg; /* operand, 0 if unused  */
+} Instr;
+
+typedef struct {
+    int line;
+    int col;
+} SrcLoc;
+
+struct Bytecode {
+    Instr  *code;
+    int     code_len, code_cap;
+    Value  *consts;      /* constant pool               */
+    int     const_count, const_cap;
+    SrcLoc *locs;        /* positions of OP_DIV          */
+    int     loc_count, loc_cap;
+    int     slot_count;  /* slots the program reads/writes */
+    int     max_stack;   /* deepest operand stack needed  */
+    int     checked;     /* compiled with checked arithmetic */
+};
+
+/* Append one instruction; depth is the stack depth after it runs */
+static void emit(Bytecode *bc, int op, int arg, int depth) {
+    if (bc->code_len == bc->code_cap) {
+        bc->code_cap = bc->code_cap ? bc->code_cap * 2 : 256;
+        bc->code = (Instr *)xrealloc(bc->code, bc->code_cap * sizeof(Instr));
+    }
+    bc->code[bc->code_len].op  = op;
+    bc->code[bc->code_len].arg = arg;
+    bc->code_len++;
+    if (depth > bc->max_stack) bc->max_stack = depth;
+}
+
+static int add_const(Bytecode *bc, Value value) {
+    if (bc->const_count == bc->const_cap) {
+        bc->const_cap = bc->const_cap ? bc->const_cap * 2 : 64;
+        bc->consts = (Value *)xrealloc(bc->consts, bc->const_cap * sizeof(Value));
+    }
+    bc->consts[bc->const_count] = value;
+    return bc->const_count++;
+}
+
+static int add_loc(Bytecode *bc, int line, int col) {
+    if (bc->loc_count == bc->loc_cap) {
+        bc->loc_cap = bc->loc_cap ? bc->loc_cap * 2 : 64;
+        bc->locs = (SrcLoc *)xrealloc(bc->locs, bc->loc_cap * sizeof(SrcLoc));
+    }
+    bc->locs[bc->loc_count].line = line;
+    bc->locs[bc->loc_count].col  = col;
+    return bc->loc_count++;
+}
+
+/* Emit code leaving the value of an expression, whose nodes are listed
+   in evaluation order, on the empty stack */
+static void compile_expr(Bytecode *bc, const NodeList *order) {
+    static const int checked_op[] = {
+        [N_ADD] = OP_ADDC, [N_SUB] = OP_SUBC, [N_MUL] = OP_MULC, [N_DIV] = OP_DIVC
+    };
+    int depth = 0;  /* stack depth after the node */
+
+    for (int k = 0; k < order->count; k++) {
+        const Node *n = order->items[k];
+        switch (n->kind) {
+            case N_NUM:
+                emit(bc, OP_PUSH, add_const(bc, n->value), ++depth);
+                continue;
+            case N_VAR:
+                emit(bc, OP_LOAD, n->value, ++depth);
+                continue;
+            case N_SAVE:
+                emit(bc, OP_TEE, n->value, depth);
+                continue;
+            default:
+                depth--;
+                break;
+        }
+        if (bc->checked) {
+            emit(bc, checked_op[n->kind], add_loc(bc, n->line, n->col), depth);
+            continue;
+        }
+        switch (n->kind) {
+            case N_ADD: emit(bc, OP_ADD, 0, depth); break;
+            case N_SUB: emit(bc, OP_SUB, 0, depth); break;
+            case N_MUL: emit(bc, OP_MUL, 0, depth); break;
+            case N_DIV: emit(bc, OP_DIV, add_loc(bc, n->line, n->col), depth); break;
+            default: break;
+        }
+    }
+}
+
+/*
+ * Compile an error-free program into bc, with overflow checks if the
+ * context's checked option is set.  bc's arrays are reused (zero a
+ * new Bytecode first), so recompiling into the same one only grows
+ * them.
+ */
+static void compile_program(Interp *in, Bytecode *bc, const Program *prog) {
+    bc->code_len    = 0;
+    bc->const_count = 0;
+    bc->loc_count   = 0;
+    bc->max_stack   = 0;
+    bc->slot_count  = prog->slot_count;
+    bc->checked     = in->opt.checked;
+
+    for (const Stmt *s = prog->first; s; s = s->next) {
+        nodes_postorder(&in->walk, &in->walk_tmp, s->expr);
+        compile_expr(bc, &in->walk);
+        if (s->kind == S_DECL)
+            emit(bc, OP_STORE, s->slot, 0);
+        else
+            emit(bc, OP_PRINT, 0, 0);
+    }
+    emit(bc, OP_HALT, 0, 0);
+}
+
+static void bytecode_free(Bytecode *bc) {
+    free(bc->code);
+    free(bc->consts);
+    free(bc->locs);
+    memset(bc, 0, sizeof(*bc));
+}
+
+/* ======================== VIRTUAL MACHINE ======================== */
+/*
+ * vm_run() executes compiled bytecode with the same semantics as
+ * exec_program().  With GCC/Clang each handler jumps straight to the
+ * next one through a table of label addresses (computed goto);
+ * otherwise it falls back to a switch inside a loop.
+ */
+
+#ifndef VM_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+#endif
+
+#if VM_COMPUTED_GOTO
+#define VM_CASE(op) L_##op:
+#define VM_NEXT()   goto *dispatch[(++ip)->op]
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT()   { ++ip; continue; }
+#endif
+
+static void vm_run(Interp *in, const Bytecode *bc) {
+    in->vm_stack = (Value *)stack_reserve(in->vm_stack, &in->vm_stack_cap, bc->max_stack + 1,
+                                          sizeof(Value));
+    Value       *stack = in->vm_stack;
+    Value       *sp    = stack;   /* next free stack entry */
+    Value       *slots = in->slot_values;
+    const Instr *ip    = bc->code;
+
+#if VM_COMPUTED_GOTO
+    static const void *dispatch[] = {
+        [OP_PUSH]  = &&L_OP_PUSH,
+        [OP_LOAD]  = &&L_OP_LOAD,
+        [OP_STORE] = &&L_OP_STORE,
+        [OP_TEE]   = &&L_OP_TEE,
+        [OP_ADD]   = &&L_OP_ADD,
+        [OP_SUB]   = &&L_OP_SUB,
+        [OP_MUL]   = &&L_OP_MUL,
+        [OP_DIV]   = &&L_OP_DIV,
+        [OP_ADDC]  = &&L_OP_ADDC,
+        [OP_SUBC]  = &&L_OP_SUBC,
+        [OP_MULC]  = &&L_OP_MULC,
+        [OP_DIVC]  = &&L_OP_DIVC,
+        [OP_PRINT] = &&L_OP_PRINT,
+        [OP_HALT]  = &&L_OP_HALT,
+    };
+    goto *dispatch[ip->op];
+#else
+    for (;;) switch (ip->op) {
+#endif
+
+    VM_CASE(OP_PUSH)
+        *sp++ = bc->consts[ip->arg];
+        VM_NEXT();
+
+    VM_CASE(OP_LOAD)
+        *sp++ = slots[ip->arg];
+        VM_NEXT();
+
+    VM_CASE(OP_STORE)
+        slots[ip->arg] = *--sp;
+        VM_NEXT();
+
+    VM_CASE(OP_TEE)
+        slots[ip->arg] = sp[-1];
+        VM_NEXT();
+
+    VM_CASE(OP_ADD)
+        sp--;
+        sp[-1] = arith_add(sp[-1], sp[0]);
+        VM_NEXT();
+
+    VM_CASE(OP_SUB)
+        sp--;
+        sp[-1] = arith_sub(sp[-1], sp[0]);
+        VM_NEXT();
+
+    VM_CASE(OP_MUL)
+        sp--;
+        sp[-1] = arith_mul(sp[-1], sp[0]);
+        VM_NEXT();
+
+    VM_CASE(OP_DIV)
+        sp--;
+        if (sp[0] == 0) {
+            diag(in, DIAG_RUNTIME, bc->locs[ip->arg].line,
+                 bc->locs[ip->arg].col, "division by zero");
+            in->had_error = 1;
+            sp[-1] = 0;
+        } else {
+            sp[-1] = arith_div(sp[-1], sp[0]);
+        }
+        VM_NEXT();
+
+    VM_CASE(OP_ADDC)
+        sp--;
+        if (__builtin_add_overflow(sp[-1], sp[0], &sp[-1])) {
+            report_overflow(in, bc->locs[ip->arg].line, bc->locs[ip->arg].col);
+            sp[-1] = 0;
+        }
+        VM_NEXT();
+
+    VM_CASE(OP_SUBC)
+        sp--;
+        if (__builtin_sub_overflow(sp[-1], sp[0], &sp[-1])) {
+            report_overflow(in, bc->locs[ip->arg].line, bc->locs[ip->arg].col);
+            sp[-1] = 0;
+        }
+        VM_NEXT();
+
+    VM_CASE(OP_MULC)
+        sp--;
+        if (__builtin_mul_overflow(sp[-1], sp[0], &sp[-1])) {
+            report_overflow(in, bc->locs[ip->arg].line, bc->locs[ip->arg].col);
+            sp[-1] = 0;
+        }
+        VM_NEXT();
+
+    VM_CASE(OP_DIVC)
+        sp--;
+        if (sp[0] == 0) {
+            diag(in, DIAG_RUNTIME, bc->locs[ip->arg].line,
+                 bc->locs[ip->arg].col, "division by zero");
+            in->had_error = 1;
+            sp[-1] = 0;
+        } else if (sp[-1] == VALUE_MIN && sp[0] == -1) {
+            report_overflow(in, bc->locs[ip->arg].line, bc->locs[ip->arg].col);
+            sp[-1] = 0;
+        } else {
+            sp[-1] /= sp[0];
+        }
+        VM_NEXT();
+
+    VM_CASE(OP_PRINT)
+        sp--;
+        if (!in->had_error) output_value(in, sp[0]);
+        VM_NEXT();
+
+    VM_CASE(OP_HALT)
+        goto halt;
+
+#if !VM_COMPUTED_GOTO
+    }
+#endif
+
+halt:
+    return;
+}
+
+#undef VM_CASE
+#undef VM_NEXT
+
+/* ======================== NATIVE JIT ======================== */
+/*
+ * jit_compile() translates compiled bytecode into x86-64 or AArch64
+ * machine code in an mmap'd buffer.  The bytecode is straight-line, so
+ * the operand-stack depth at every instruction is known in advance and
+ * each stack entry becomes a fixed location in a caller-supplied array;
+ * no dispatch or stack-pointer bookkeeping is left at run time.
+ *
+ * The generated function is   void fn(Value *slots, Value *stack,
+ *                                      JitEnv *env)
+ * Division by zero and print() call back into C (jit_div_zero() and
+ * jit_print()), so errors and output go through the same paths as the
+ * VM.  Other targets, or a failure to map executable memory, make
+ * jit_compile() fail and the caller falls back to the VM.  The code
+ * generators only handle 32-bit wrapping arithmetic, so SIL_INT64
+ * builds and checked programs also run on the VM.
+ */
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__)) && !defined(SIL_INT64)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+/* What the C helpers need; passed to the generated code */
+typedef struct {
+    Interp         *in;
+    const Bytecode *bc;
+} JitEnv;
+
+typedef void (*JitFn)(Value *slots, Value *stack, JitEnv *env);
+
+/* Growable buffer the machine code is assembled into */
+typedef struct {
+    unsigned char *buf;
+    size_t         len;
+    size_t         cap;
+} CodeBuf;
+
+/* A context's native code; the mapping and buffer are reused by the
+   next program compiled, if they are big enough */
+struct JitCode {
+    JitFn   fn;
+    void   *mem;   /* mapping holding the code */
+    size_t  size;
+    CodeBuf cb;    /* the code as assembled    */
+};
+
+#if JIT_SUPPORTED
+
+/* Called from generated code */
+static void jit_div_zero(JitEnv *env, int loc) {
+    const SrcLoc *l = &env->bc->locs[loc];
+    diag(env->in, DIAG_RUNTIME, l->line, l->col, "division by zero");
+    env->in->had_error = 1;
+}
+
+static void jit_print(JitEnv *env, Value value) {
+    if (!env->in->had_error) output_value(env->in, value);
+}
+
+static void cb_bytes(CodeBuf *cb, const void *p, size_t n) {
+    if (cb->len + n > cb->cap) {
+        while (cb->len + n > cb->cap) cb->cap = cb->cap ? cb->cap * 2 : 4096;
+        cb->buf = (unsigned char *)xrealloc(cb->buf, cb->cap);
+    }
+    memcpy(cb->buf + cb->len, p, n);
+    cb->len += n;
+}
+
+static void cb_u8(CodeBuf *cb, unsigned v) {
+    unsigned char b = (unsigned char)v;
+    cb_bytes(cb, &b, 1);
+}
+
+static void cb_u32(CodeBuf *cb, unsigned v) {
+    unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8),
+                           (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+    cb_bytes(cb, b, 4);
+}
+
+#if defined(__x86_64__)
+
+/*
+ * x86-64 (System V).  rbx = slots, r12 = stack, r13 = JitEnv; all
+ * three are callee-saved, so helper calls don't disturb them.  eax and
+ * ecx are scratch.  Three pushes keep rsp 16-byte aligned for calls.
+ */
+
+enum { X_EAX = 0, X_ECX = 1, X_ESI = 6, X_EDI = 7 };
+
+/* <op> reg, [r12 + disp32]   (op is one or two opcode bytes) */
+static void x86_stack(CodeBuf *cb, unsigned op, int reg, int index) {
+    cb_u8(cb, 0x41);                     /* REX.B: base is r12   */
+    if (op > 0xFF) cb_u8(cb, op >> 8);
+    cb_u8(cb, op & 0xFF);
+    cb_u8(cb, 0x84 | (reg << 3));        /* mod=10, rm=100 (SIB) */
+    cb_u8(cb, 0x24);                     /* base=r12, no index   */
+    cb_u32(cb, (unsigned)index * 4);
+}
+
+/* <op> reg, [rbx + disp32] */
+static void x86_slot(CodeBuf *cb, unsigned op, int reg, int index) {
+    cb_u8(cb, op);
+    cb_u8(cb, 0x83 | (reg << 3));        /* mod=10, rm=rbx       */
+    cb_u32(cb, (unsigned)index * 4);
+}
+
+/* mov rdi, r13 ; mov esi, <arg> ; call helper */
+static void x86_call(CodeBuf *cb, void *helper) {
+    unsigned long long addr = (unsigned long long)(size_t)helper;
+    cb_bytes(cb, "\x4C\x89\xEF", 3);     /* mov rdi, r13   */
+    cb_u8(cb, 0x48); cb_u8(cb, 0xB8);    /* mov rax, imm64 */
+    cb_u32(cb, (unsigned)addr);
+    cb_u32(cb, (unsigned)(addr >> 32));
+    cb_bytes(cb, "\xFF\xD0", 2);         /* call rax       */
+}
+
+/* Emit a short jump opcode and return the offset of its rel8 */
+static size_t x86_jump8(CodeBuf *cb, unsigned op) {
+    cb_u8(cb, op);
+    cb_u8(cb, 0);
+    return cb->len - 1;
+}
+
+static void x86_patch8(CodeBuf *cb, size_t at) {
+    cb->buf[at] = (unsigned char)(cb->len - (at + 1));
+}
+
+static void jit_emit(CodeBuf *cb, const Bytecode *bc) {
+    /* push rbx ; push r12 ; push r13 ; mov rbx, rdi ; mov r12, rsi ; mov r13, rdx */
+    cb_bytes(cb, "\x53\x41\x54\x41\x55", 5);
+    cb_bytes(cb, "\x48\x89\xFB\x49\x89\xF4\x49\x89\xD5", 9);
+
+    int d = 0; /* operand stack depth */
+    for (int i = 0; i < bc->code_len; i++) {
+        const Instr *in = &bc->code[i];
+        switch (in->op) {
+            case OP_PUSH:
+                cb_u8(cb, 0x41); cb_u8(cb, 0xC7);   /* mov dword [r12+disp], imm */
+                cb_u8(cb, 0x84); cb_u8(cb, 0x24);
+                cb_u32(cb, (unsigned)d * 4);
+                cb_u32(cb, (unsigned)bc->consts[in->arg]);
+                d++;
+                break;
+            case OP_LOAD:
+                x86_slot(cb, 0x8B, X_EAX, in->arg);    /* mov eax, [slot]   */
+                x86_stack(cb, 0x89, X_EAX, d);         /* mov [stack], eax  */
+                d++;
+                break;
+            case OP_STORE:
+            case OP_TEE:
+                x86_stack(cb, 0x8B, X_EAX, d - 1);
+                x86_slot(cb, 0x89, X_EAX, in->arg);
+                if (in->op == OP_STORE) d--;
+                break;
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+                x86_stack(cb, 0x8B, X_EAX, d - 2);
+                x86_stack(cb, in->op == OP_ADD ? 0x03 :     /* add  */
+                              in->op == OP_SUB ? 0x2B :     /* sub  */
+                                                 0x0FAF,    /* imul */
+                          X_EAX, d - 1);
+                x86_stack(cb, 0x89, X_EAX, d - 2);
+                d--;
+                break;
+            case OP_DIV: {
+                x86_stack(cb, 0x8B, X_EAX, d - 2);
+                x86_stack(cb, 0x8B, X_ECX, d - 1);
+                cb_bytes(cb, "\x85\xC9", 2);           /* test ecx, ecx  */
+                size_t nonzero = x86_jump8(cb, 0x75);  /* jnz            */
+                cb_u8(cb, 0xBE);                       /* mov esi, loc   */
+                cb_u32(cb, (unsigned)in->arg);
+                x86_call(cb, (void *)jit_div_zero);
+                cb_bytes(cb, "\x31\xC0", 2);           /* xor eax, eax   */
+                size_t done1 = x86_jump8(cb, 0xEB);    /* jmp done       */
+                x86_patch8(cb, nonzero);
+                cb_bytes(cb, "\x83\xF9\xFF", 3);       /* cmp ecx, -1    */
+                size_t divide = x86_jump8(cb, 0x75);   /* jne divide     */
+                cb_bytes(cb, "\xF7\xD8", 2);           /* neg eax (wraps) */
+                size_t done2 = x86_jump8(cb, 0xEB);    /* jmp done       */
+                x86_patch8(cb, divide);
+                cb_bytes(cb, "\x99\xF7\xF9", 3);       /* cdq ; idiv ecx */
+                x86_patch8(cb, done1);
+                x86_patch8(cb, done2);
+                x86_stack(cb, 0x89, X_EAX, d - 2);
+                d--;
+                break;
+            }
+            case OP_PRINT:
+                x86_stack(cb, 0x8B, X_ESI, d - 1);     /* mov esi, value */
+                x86_call(cb, (void *)jit_print);
+                d--;
+                break;
+            case OP_HALT:
+                break;
+        }
+    }
+
+    /* pop r13 ; pop r12 ; pop rbx ; ret */
+    cb_bytes(cb, "\x41\x5D\x41\x5C\x5B\xC3", 6);
+}
+
+#elif defined(__aarch64__)
+
+/*
+ * AArch64 (AAPCS64).  x19 = slots, x20 = stack, x21 = JitEnv, all
+ * callee-saved; w0/w1 are scratch and x16 holds large offsets and
+ * helper addresses.
+ */
+
+enum { A_W0 = 0, A_W1 = 1, A_X16 = 16, A_X19 = 19, A_X20 = 20, A_X21 = 21 };
+
+/* movz/movk a 32-bit constant into w<rd> */
+static void a64_mov32(CodeBuf *cb, int rd, unsigned v) {
+    cb_u32(cb, 0x52800000u | ((v & 0xFFFF) << 5) | rd);            /* movz */
+    if (v >> 16)
+        cb_u32(cb, 0x72A00000u | ((v >> 16) << 5) | rd);           /* movk, lsl 16 */
+}
+
+/* ldr/str w<rt>, [x<rn>, #index*4] */
+static void a64_word(CodeBuf *cb, int load, int rt, int rn, int index) {
+    if (index < 4096) {
+        cb_u32(cb, (load ? 0xB9400000u : 0xB9000000u) |
+                   ((unsigned)index << 10) | (rn << 5) | rt);
+    } else {
+        a64_mov32(cb, A_X16, (unsigned)index);
+        cb_u32(cb, (load ? 0xB8607800u : 0xB8207800u) |            /* [xn, x16, lsl #2] */
+                   (A_X16 << 16) | (rn << 5) | rt);
+    }
+}
+
+/* mov x0, x21 ; mov x16, helper ; blr x16 */
+static void a64_call(CodeBuf *cb, void *helper) {
+    unsigned long long addr = (unsigned long long)(size_t)helper;
+    cb_u32(cb, 0xAA0003E0u | (A_X21 << 16) | 0);
+    cb_u32(cb, 0xD2800000u | ((unsigned)(addr & 0xFFFF) << 5) | A_X16);
+    for (unsigned hw = 1; hw < 4; hw++)
+        cb_u32(cb, 0xF2800000u | (hw << 21) |
+                   ((unsigned)((addr >> (16 * hw)) & 0xFFFF) << 5) | A_X16);
+    cb_u32(cb, 0xD63F0000u | (A_X16 << 5));
+}
+
+static void a64_patch_branch(CodeBuf *cb, size_t at, unsigned base, unsigned bits) {
+    unsigned delta = (unsigned)((cb->len - at) / 4);
+    unsigned insn  = base | ((delta & ((1u << bits) - 1)) << (bits == 19 ? 5 : 0));
+    memcpy(cb->buf + at, &insn, 4);
+}
+
+static void jit_emit(CodeBuf *cb, const Bytecode *bc) {
+    cb_u32(cb, 0xA9BD7BFDu);  /* stp x29, x30, [sp, #-48]! */
+    cb_u32(cb, 0x910003FDu);  /* mov x29, sp               */
+    cb_u32(cb, 0xA90153F3u);  /* stp x19, x20, [sp, #16]   */
+    cb_u32(cb, 0xF90013F5u);  /* str x21, [sp, #32]        */
+    cb_u32(cb, 0xAA0003F3u);  /* mov x19, x0               */
+    cb_u32(cb, 0xAA0103F4u);  /* mov x20, x1               */
+    cb_u32(cb, 0xAA0203F5u);  /* mov x21, x2               */
+
+    int d = 0; /* operand stack depth */
+    for (int i = 0; i < bc->code_len; i++) {
+        const Instr *in = &bc->code[i];
+        switch (in->op) {
+            case OP_PUSH:
+                a64_mov32(cb, A_W0, (unsigned)bc->consts[in->arg]);
+                a64_word(cb, 0, A_W0, A_X20, d);
+                d++;
+                break;
+            case OP_LOAD:
+                a64_word(cb, 1, A_W0, A_X19, in->arg);
+                a64_word(cb, 0, A_W0, A_X20, d);
+                d++;
+                break;
+            case OP_STORE:
+            case OP_TEE:
+                a64_word(cb, 1, A_W0, A_X20, d - 1);
+                a64_word(cb, 0, A_W0, A_X19, in->arg);
+                if (in->op == OP_STORE) d--;
+                break;
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+                a64_word(cb, 1, A_W0, A_X20, d - 2);
+                a64_word(cb, 1, A_W1, A_X20, d - 1);
+                cb_u32(cb, in->op == OP_ADD ? 0x0B010000u :   /* add w0, w0, w1 */
+                           in->op == OP_SUB ? 0x4B010000u :   /* sub w0, w0, w1 */
+                                              0x1B017C00u);   /* mul w0, w0, w1 */
+                a64_word(cb, 0, A_W0, A_X20, d - 2);
+                d--;
+                break;
+            case OP_DIV: {
+                a64_word(cb, 1, A_W0, A_X20, d - 2);
+                a64_word(cb, 1, A_W1, A_X20, d - 1);
+                size_t nonzero = cb->len;
+                cb_u32(cb, 0);                          /* cbnz w1, divide */
+                a64_mov32(cb, A_W1, (unsigned)in->arg);
+                a64_call(cb, (void *)jit_div_zero);
+                cb_u32(cb, 0x52800000u);                /* mov w0, #0 */
+                size_t done = cb->len;
+                cb_u32(cb, 0);                          /* b done */
+                a64_patch_branch(cb, nonzero, 0x35000000u | A_W1, 19);
+                cb_u32(cb, 0x1AC10C00u);                /* sdiv w0, w0, w1 (wraps) */
+                a64_patch_branch(cb, done, 0x14000000u, 26);
+                a64_word(cb, 0, A_W0, A_X20, d - 2);
+                d--;
+                break;
+            }
+            case OP_PRINT:
+                a64_word(cb, 1, A_W1, A_X20, d - 1);
+                a64_call(cb, (void *)jit_print);
+                d--;
+                break;
+            case OP_HALT:
+                break;
+        }
+    }
+
+    cb_u32(cb, 0xF94013F5u);  /* ldr x21, [sp, #32]       */
+    cb_u32(cb, 0xA94153F3u);  /* ldp x19, x20, [sp, #16]   */
+    cb_u32(cb, 0xA8C37BFDu);  /* ldp x29, x30, [sp], #48   */
+    cb_u32(cb, 0xD65F03C0u);  /* ret                       */
+}
+
+#endif /* architecture */
+
+/* Translate bc to native code in jc; returns 0 on success */
+static int jit_compile(JitCode *jc, const Bytecode *bc) {
+    jc->cb.len = 0;
+    jit_emit(&jc->cb, bc);
+
+    long   page = sysconf(_SC_PAGESIZE);
+    size_t size = (jc->cb.len + page - 1) & ~(size_t)(page - 1);
+    if (jc->mem && size > jc->size) {
+        munmap(jc->mem, jc->size);
+        jc->mem = NULL;
+    }
+    if (!jc->mem) {
+        void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return -1;
+        jc->mem  = mem;
+        jc->size = size;
+    } else if (mprotect(jc->mem, jc->size, PROT_READ | PROT_WRITE) != 0) {
+        return -1;
+    }
+    memcpy(jc->mem, jc->cb.buf, jc->cb.len);
+    if (mprotect(jc->mem, jc->size, PROT_READ | PROT_EXEC) != 0) return -1;
+    __builtin___clear_cache((char *)jc->mem, (char *)jc->mem + jc->cb.len);
+
+    jc->fn = (JitFn)jc->mem;
+    return 0;
+}
+
+static void jit_free(JitCode *jc) {
+    if (!jc) return;
+    if (jc->mem) munmap(jc->mem, jc->size);
+    free(jc->cb.buf);
+    free(jc);
+}
+
+#else /* !JIT_SUPPORTED */
+
+static int jit_compile(JitCode *jc, const Bytecode *bc) {
+    (void)jc;
+    (void)bc;
+    return -1;
+}
+
+static void jit_free(JitCode *jc) {
+    free(jc);
+}
+
+#endif /* JIT_SUPPORTED */
+
+/* Run bc natively if it can be compiled; returns 0 if it ran */
+static int jit_run(Interp *in, const Bytecode *bc) {
+    if (bc->checked) return -1;
+    if (!in->jit) {
+        in->jit = (JitCode *)xmalloc(sizeof(JitCode));
+        memset(in->jit, 0, sizeof(JitCode));
+    }
+    if (jit_compile(in->jit, bc) != 0) return -1;
+
+    in->vm_stack = (Value *)stack_reserve(in->vm_stack, &in->vm_stack_cap, bc->max_stack + 1,
+                                          sizeof(Value));
+    JitEnv env = { in, bc };
+    in->jit->fn(in->slot_values, in->vm_stack, &env);
+    return 0;
+}
+
+/* ======================== PROGRAM CACHE ======================== */
+/*
+ * The vm and jit engines can skip lexing, parsing, optimisation and
+ * compilation for source they have seen before.  Compiled Bytecode is
+ * kept in a per-context LRU cache keyed by a 64-bit hash of the source
+ * (and the optimise and checked flags), and optionally written to a
+ * directory so that later processes can load it instead of compiling.
+ * Entries keep a copy of the source, so a hash collision is only ever a
+ * miss.
+ *
+ * Only programs that compiled without errors are cached.
+ */
+
+#define CACHE_FORMAT_VERSION 2
+#define CACHE_DEFAULT_DIR    ".sil.cache"
+
+typedef struct {
+    uint64_t hash;
+    char    *src;        /* copy of the source it was compiled from */
+    size_t   src_len;
+    Bytecode bc;
+    int      prev, next; /* LRU list, most recent first; -1 ends it */
+    int      chain;      /* next entry in the same bucket, or -1     */
+} CacheEntry;
+
+struct ProgCache {
+    CacheEntry   *entries;
+    int           count, cap;  /* cap = configured size limit */
+    int           alloc;       /* entries[] allocated         */
+    int          *buckets;     /* entry index, or -1          */
+    unsigned      mask;
+    int           head, tail;  /* most and least recently used */
+    InterpCacheStats stats;
+};
+
+/* Hash the source eight bytes at a time */
+static uint64_t source_hash(const char *p, size_t len, uint64_t seed) {
+    const uint64_t m = 0x9E3779B97F4A7C15ull;
+    uint64_t h = seed ^ (len * m);
+    uint64_t w;
+
+    while (len >= 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * m;
+        h ^= h >> 29;
+        p += 8;
+        len -= 8;
+    }
+    w = 0;
+    memcpy(&w, p, len);
+    h = (h ^ w) * m;
+    h ^= h >> 32;
+    h *= m;
+    h ^= h >> 29;
+    return h;
+}
+
+static ProgCache *cache_create(int size) {
+    ProgCache *c = (ProgCache *)xmalloc(sizeof(ProgCache));
+    memset(c, 0, sizeof(*c));
+    c->cap = size > 0 ? size : 1;
+
+    unsigned n = 16;
+    while (n < (unsigned)c->cap * 2) n *= 2;
+    c->buckets = (int *)xmalloc(n * sizeof(int));
+    c->mask    = n - 1;
+    for (unsigned i = 0; i < n; i++) c->buckets[i] = -1;
+    c->head = c->tail = -1;
+    return c;
+}
+
+static void cache_free(ProgCache *c) {
+    if (!c) return;
+    for (int i = 0; i < c->count; i++) {
+        free(c->entries[i].src);
+        bytecode_free(&c->entries[i].bc);
+    }
+    free(c->entries);
+    free(c->buckets);
+    free(c);
+}
+
+static void lru_unlink(ProgCache *c, int i) {
+    CacheEntry *e = &c->entries[i];
+    if (e->prev >= 0) c->entries[e->prev].next = e->next; else c->head = e->next;
+    if (e->next >= 0) c->entries[e->next].prev = e->prev; else c->tail = e->prev;
+}
+
+static void lru_push_front(ProgCache *c, int i) {
+    CacheEntry *e = &c->entries[i];
+    e->prev = -1;
+    e->next = c->head;
+    if (c->head >= 0) c->entries[c->head].prev = i; else c->tail = i;
+    c->head = i;
+}
+
+/* Find the entry for this exact source, or return -1 */
+static int cache_find(ProgCache *c, uint64_t hash, const char *src, size_t len) {
+    for (int i = c->buckets[hash & c->mask]; i >= 0; i = c->entries[i].chain) {
+        CacheEntry *e = &c->entries[i];
+        if (e->hash == hash && e->src_len == len && memcmp(e->src, src, len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Store *bc for this source, taking ownership of its arrays */
+static const Bytecode *cache_insert(ProgCache *c, uint64_t hash, const char *src,
+                                    size_t len, Bytecode *bc) {
+    int i;
+    if (c->count < c->cap) {
+        if (c->count == c->alloc) {
+            c->alloc = c->alloc ? c->alloc * 2 : 16;
+            if (c->alloc > c->cap) c->alloc = c->cap;
+            c->entries = (CacheEntry *)xrealloc(c->entries, c->alloc * sizeof(CacheEntry));
+        }
+        i = c->count++;
+    } else {
+        /* Evict the least recently used entry and reuse its place */
+        i = c->tail;
+        CacheEntry *old = &c->entries[i];
+        int *link = &c->buckets[old->hash & c->mask];
+        while (*link != i) link = &c->entries[*link].chain;
+        *link = old->chain;
+        lru_unlink(c, i);
+        free(old->src);
+        bytecode_free(&old->bc);
+    }
+
+    CacheEntry *e = &c->entries[i];
+    e->hash    = hash;
+    e->src     = (char *)xmalloc(len ? len : 1);
+    e->src_len = len;
+    memcpy(e->src, src, len);
+    e->bc      = *bc;
+    e->chain   = c->buckets[hash & c->mask];
+    c->buckets[hash & c->mask] = i;
+    lru_push_front(c, i);
+    return &e->bc;
+}
+
+/*
+ * Serialized bytecode, all fields native-endian:
+ *     CacheHeader, Instr code[code_len], Value consts[const_count],
+ *     SrcLoc locs[loc_count], char source[src_len]
+ */
+typedef struct {
+    char     magic[4];     /* "SILB"                              */
+    uint32_t version;      /* CACHE_FORMAT_VERSION                */
+    uint32_t flags;        /* bit 0: optimised, bit 1: checked    */
+    uint32_t value_size;   /* sizeof(Value) of the writer         */
+    uint32_t slot_count, max_stack;
+    uint32_t code_len, const_count, loc_count;
+    uint32_t reserved;
+    uint64_t src_len;
+    uint64_t hash;         /* source_hash() of the source          */
+    uint64_t check;        /* bytecode_check() of the arrays       */
+} CacheHeader;
+
+/*
+ * The VM and JIT trust operands and the recorded stack depth, so a
+ * program read from disk is checked before it is used.  Returns 1 if
+ * every operand is in range and the stack stays within max_stack.
+ */
+static int bytecode_verify(const Bytecode *bc) {
+    int depth = 0;
+    if (bc->code_len <= 0 || bc->code[bc->code_len - 1].op != OP_HALT) return 0;
+    for (int i = 0; i < bc->code_len; i++) {
+        int arg = bc->code[i].arg;
+        switch (bc->code[i].op) {
+            case OP_PUSH:
+                if (arg < 0 || arg >= bc->const_count) return 0;
+                depth++;
+                break;
+            case OP_LOAD:
+                if (arg < 0 || arg >= bc->slot_count) return 0;
+                depth++;
+                break;
+            case OP_STORE:
+            case OP_TEE:
+                if (arg < 0 || arg >= bc->slot_count || depth < 1) return 0;
+                if (bc->code[i].op == OP_STORE) depth--;
+                break;
+            case OP_DIV:
+            case OP_ADDC:
+            case OP_SUBC:
+            case OP_MULC:
+            case OP_DIVC:
+                if (arg < 0 || arg >= bc->loc_count) return 0;
+                /* fall through */
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+                if (depth < 2) return 0;
+                depth--;
+                break;
+            case OP_PRINT:
+                if (depth < 1) return 0;
+                depth--;
+                break;
+            case OP_HALT:
+                if (i != bc->code_len - 1 || depth != 0) return 0;
+                break;
+            default:
+                return 0;
+        }
+        if (depth > bc->max_stack) return 0;
+    }
+    return 1;
+}
+
+/* Checksum of a program's arrays, to catch damaged cache files */
+static uint64_t bytecode_check(const Bytecode *bc) {
+    uint64_t h = source_hash((const char *)bc->code, bc->code_len * sizeof(Instr), 1);
+    h = source_hash((const char *)bc->consts, bc->const_count * sizeof(Value), h);
+    return source_hash((const char *)bc->locs, bc->loc_count * sizeof(SrcLoc), h);
+}
+
+/* Path of the cache file for hash in dir */
+static void cache_path(char *buf, size_t size, const char *dir, uint64_t hash) {
+    snprintf(buf, size, "%s/%016llx.silb", dir, (unsigned long long)hash);
+}
+
+/* Size of the open file fp in bytes, or 0 if it cannot be told */
+static uint64_t cache_file_size(FILE *fp) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    return fstat(fileno(fp), &st) == 0 && st.st_size > 0 ? (uint64_t)st.st_size : 0;
+#else
+    long here = ftell(fp), size = -1;
+    if (here >= 0 && fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+    if (here < 0 || fseek(fp, here, SEEK_SET) != 0) size = -1;
+    return size > 0 ? (uint64_t)size : 0;
+#endif
+}
+
+/* Load a cached program from dir into *bc; returns 0 on a hit */
+static int cache_load(const char *dir, uint64_t hash, const char *src, size_t len,
+                      uint32_t flags, Bytecode *bc) {
+    char path[4096];
+    cache_path(path, sizeof(path), dir, hash);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+
+    /* The counts are bounded as silc_open() bounds them, and must
+       account for the whole file before anything is allocated */
+    CacheHeader h;
+    int ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+             memcmp(h.magic, "SILB", 4) == 0 &&
+             h.version == CACHE_FORMAT_VERSION && h.flags == flags &&
+             h.value_size == sizeof(Value) && h.hash == hash && h.src_len == len &&
+             h.code_len > 0 && h.code_len <= INT_MAX && h.const_count <= INT_MAX &&
+             h.loc_count <= INT_MAX && h.slot_count <= h.code_len &&
+             h.max_stack <= h.code_len &&
+             cache_file_size(fp) == sizeof(h) + (uint64_t)h.code_len * sizeof(Instr) +
+                                        (uint64_t)h.const_count * sizeof(Value) +
+                                        (uint64_t)h.loc_count * sizeof(SrcLoc) + len;
+
+    memset(bc, 0, sizeof(*bc));
+    char *text = NULL;
+    if (ok) {
+        bc->code   = (Instr *)xmalloc(h.code_len * sizeof(Instr));
+        bc->consts = (Value *)xmalloc((h.const_count + 1) * sizeof(Value));
+        bc->locs   = (SrcLoc *)xmalloc((h.loc_count + 1) * sizeof(SrcLoc));
+        text       = (char *)xmalloc(len ? len : 1);
+        ok = fread(bc->code, sizeof(Instr), h.code_len, fp) == h.code_len &&
+             fread(bc->consts, sizeof(Value), h.const_count, fp) == h.const_count &&
+             fread(bc->locs, sizeof(SrcLoc), h.loc_count, fp) == h.loc_count &&
+             fread(text, 1, len, fp) == len && memcmp(text, src, len) == 0;
+    }
+    fclose(fp);
+    free(text);
+
+    if (ok) {
+        bc->code_len    = bc->code_cap  = (int)h.code_len;
+        bc->const_count = bc->const_cap = (int)h.const_count;
+        bc->loc_count   = bc->loc_cap   = (int)h.loc_count;
+        bc->slot_count  = (int)h.slot_count;
+        bc->max_stack   = (int)h.max_stack;
+        bc->checked     = (flags & 2u) != 0;
+        ok = bytecode_check(bc) == h.check && bytecode_verify(bc);
+    }
+    if (!ok) {
+        bytecode_free(bc);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Write bc to dir.  The file is written under a temporary name and
+ * renamed into place, so concurrent readers never see part of one.
+ */
+static void cache_save(const Interp *in, const char *dir, uint64_t hash,
+                       const char *src, size_t len, uint32_t flags, const Bytecode *bc) {
+    char path[4096], tmp[4200];
+    CacheHeader h;
+
+#if defined(__unix__) || defined(__APPLE__)
+    mkdir(dir, 0777);  /* usually exists already */
+    snprintf(tmp, sizeof(tmp), "%s/tmp.%lu.%p", dir, (unsigned long)getpid(), (const void *)in);
+#else
+    snprintf(tmp, sizeof(tmp), "%s/tmp.%p", dir, (const void *)in);
+#endif
+    cache_path(path, sizeof(path), dir, hash);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return;  /* the cache is an optimisation: ignore failures */
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "SILB", 4);
+    h.version     = CACHE_FORMAT_VERSION;
+    h.flags       = flags;
+    h.value_size  = sizeof(Value);
+    h.slot_count  = (uint32_t)bc->slot_count;
+    h.max_stack   = (uint32_t)bc->max_stack;
+    h.code_len    = (uint32_t)bc->code_len;
+    h.const_count = (uint32_t)bc->const_count;
+    h.loc_count   = (uint32_t)bc->loc_count;
+    h.src_len     = len;
+    h.hash        = hash;
+    h.check       = bytecode_check(bc);
+
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+             fwrite(bc->code, sizeof(Instr), bc->code_len, fp) == (size_t)bc->code_len &&
+             fwrite(bc->consts, sizeof(Value), bc->const_count, fp) == (size_t)bc->const_count &&
+             fwrite(bc->locs, sizeof(SrcLoc), bc->loc_count, fp) == (size_t)bc->loc_count &&
+             fwrite(src, 1, len, fp) == len;
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) remove(tmp);
+}
+
+/*
+ * cache_lookup() - Return the compiled program for src from memory or
+ * disk, or NULL on a miss.  Key and flags are filled in either way so
+ * the caller can store what it compiles.
+ */
+static const Bytecode *cache_lookup(Interp *in, const char *src, size_t len,
+                                    uint64_t *key, uint32_t *flags) {
+    if (!in->cache) in->cache = cache_create(in->opt.cache_size);
+    ProgCache *c = in->cache;
+
+    *flags = (in->opt.optimise ? 1u : 0u) | (in->opt.checked ? 2u : 0u);
+    *key   = source_hash(src, len, CACHE_FORMAT_VERSION * 2 + *flags);
+
+    int i = cache_find(c, *key, src, len);
+    if (i >= 0) {
+        lru_unlink(c, i);
+        lru_push_front(c, i);
+        c->stats.hits++;
+        return &c->entries[i].bc;
+    }
+
+    Bytecode bc;
+    if (in->opt.cache_dir && cache_load(in->opt.cache_dir, *key, src, len, *flags, &bc) == 0) {
+        c->stats.disk_hits++;
+        return cache_insert(c, *key, src, len, &bc);
+    }
+
+    c->stats.misses++;
+    return NULL;
+}
+
+/* Keep a freshly compiled program; takes ownership of *bc */
+static const Bytecode *cache_store(Interp *in, const char *src, size_t len,
+                                   uint64_t key, uint32_t flags, Bytecode *bc) {
+    if (in->opt.cache_dir) cache_save(in, in->opt.cache_dir, key, src, len, flags, bc);
+    return cache_insert(in->cache, key, src, len, bc);
+}
+
+/* ======================== PROGRAM DRIVERS ======================== */
+
+/*
+ * Program -> StmtList EOF
+ * StmtList -> Stmt StmtList | epsilon
+ *
+ * parse_program() parses the whole input into *prog for later
+ * execution.  run_program() is the streaming interpreter: it executes
+ * each statement as soon as it has been parsed and then recycles the
+ * AST arena, so memory use does not depend on program length.  Both
+ * lex large inputs in parallel when that is enabled, and both stop
+ * early once max_errors diagnostics have been reported.
+ */
+static void parse_program(Interp *in, Program *prog) {
+    prog->first = prog->last = NULL;
+    prog->stmt_count = 0;
+    plex_begin(in);
+
+    while (!check(in, TOK_EOF) && !errors_exhausted(in)) {
+        Stmt *s = parse_stmt(in);
+        if (!s) continue;
+        if (prog->last) prog->last->next = s; else prog->first = s;
+        prog->last = s;
+        prog->stmt_count++;
+    }
+    plex_end(in);
+    prog->slot_count = in->sym_count;
+}
+
+static void run_program(Interp *in) {
+    plex_begin(in);
+    while (!check(in, TOK_EOF) && !errors_exhausted(in)) {
+        Stmt *s = parse_stmt(in);
+        if (s) exec_stmt(in, s);
+        arena_reset(&in->ast_arena);
+    }
+    plex_end(in);
+}
+
+/*
+ * check_program() streams like run_program() but executes nothing: it
+ * reports what the lexer, the parser and its semantic checks find,
+ * plus division by a constant zero, which folding each statement
+ * exposes and reports as the Runtime Error a run would.  A statement
+ * that had errors of its own is not folded, as its placeholder zeros
+ * would be reported as divisors.
+ */
+static void check_program(Interp *in) {
+    plex_begin(in);
+    while (!check(in, TOK_EOF) && !errors_exhausted(in)) {
+        int   reported = in->diag_count;
+        Stmt *s        = parse_stmt(in);
+        if (s && in->diag_count == reported) fold_stmt(in, s, &in->walk, &in->walk_tmp);
+        arena_reset(&in->ast_arena);
+    }
+    plex_end(in);
+}
+
+/* ======================== RUNNING PROGRAMS ======================== */
+
+/* Run compiled code natively if the JIT is selected and available */
+static void run_bytecode(Interp *in, const Bytecode *bc) {
+    slots_reserve(in, bc->slot_count);
+    if (in->opt.engine != ENGINE_JIT || jit_run(in, bc) != 0)
+        vm_run(in, bc);
+}
+
+/* Parse a whole program and optimise it if that is enabled */
+static void parse_optimised(Interp *in, Program *prog) {
+    STAT_BEGIN(in);
+    parse_program(in, prog);
+    STAT_END(in, PHASE_PARSE);
+    if (!in->had_error && in->opt.optimise) {
+        STAT_BEGIN(in);
+        optimise_program(in, prog);
+        STAT_END(in, PHASE_OPTIMISE);
+    }
+}
+
+static void compile_timed(Interp *in, Bytecode *bc, const Program *prog) {
+    STAT_BEGIN(in);
+    compile_program(in, bc, prog);
+    STAT_END(in, PHASE_COMPILE);
+}
+
+/*
+ * run_source() - Parses and executes len bytes of source with the
+ * context's options.  Returns 1 if any error was reported, else 0.
+ */
+static int run_source(Interp *in, const char *src, size_t len) {
+    retained_free(in->retained);  /* its symbols are about to go */
+    in->retained = NULL;
+    parser_init(in, src, len);
+    sym_reset(in);
+
+    if (in->opt.check_only) {
+        /* --- Tokenisation, parsing and checks only --- */
+        STAT_BEGIN(in);
+        check_program(in);
+        STAT_END(in, PHASE_PARSE);
+    } else if (in->opt.engine == ENGINE_DIRECT) {
+        /* --- Tokenisation, parsing and execution run as one pass --- */
+        STAT_BEGIN(in);
+        run_program(in);
+        STAT_END(in, PHASE_DIRECT);
+    } else if (in->opt.engine != ENGINE_AST && in->opt.engine != ENGINE_PARALLEL &&
+               (in->opt.cache_size > 0 || in->opt.cache_dir)) {
+        /* --- Compiled-program cache, then compile on a miss --- */
+        uint64_t        key;
+        uint32_t        flags;
+        const Bytecode *bc = cache_lookup(in, src, len, &key, &flags);
+        if (!bc) {
+            Program prog;
+            parse_optimised(in, &prog);
+            if (!in->had_error) {
+                Bytecode fresh;
+                memset(&fresh, 0, sizeof(fresh));
+                compile_timed(in, &fresh, &prog);
+                bc = cache_store(in, src, len, key, flags, &fresh);
+            }
+        }
+        if (bc) {
+            STAT_BEGIN(in);
+            run_bytecode(in, bc);
+            STAT_END(in, PHASE_EXECUTE);
+        }
+    } else {
+        /* --- Parse everything first, then execute --- */
+        Program prog;
+        parse_optimised(in, &prog);
+        if (!in->had_error) {
+            slots_reserve(in, prog.slot_count);
+            if (in->opt.engine == ENGINE_AST || in->opt.engine == ENGINE_PARALLEL) {
+                STAT_BEGIN(in);
+                if (in->opt.engine == ENGINE_AST)
+                    exec_program(in, &prog);
+                else
+                    exec_parallel(in, &prog);
+                STAT_END(in, PHASE_EXECUTE);
+            } else {
+                if (!in->code) {
+                    in->code = (Bytecode *)xmalloc(sizeof(Bytecode));
+                    memset(in->code, 0, sizeof(Bytecode));
+                }
+                compile_timed(in, in->code, &prog);
+                STAT_BEGIN(in);
+                run_bytecode(in, in->code);
+                STAT_END(in, PHASE_EXECUTE);
+            }
+        }
+    }
+
+    output_flush(in);
+    arena_reset(&in->ast_arena);
+    return in->had_error || in->lex_error;
+}
+
+/* ======================== PRECOMPILED PROGRAMS ======================== */
+/*
+ * `parser --compile in -o out.silc` saves a program's bytecode in a
+ * .silc file, which later runs execute without lexing, parsing or
+ * compiling anything.  Nothing is deserialised either: the bytecode
+ * arrays are used in place in the mapped file, and loading is one
+ * pass of checksumming and verifying them.
+ *
+ * Layout, all fields native-endian: a SilcHeader, then the code, the
+ * constant pool and the location table, each at the offset given in
+ * the header and aligned to SILC_ALIGN.  Offsets count from the start
+ * of the file, so it can be mapped anywhere.  Files from a machine with
+ * another byte order or Value size are rejected, not converted.
+ */
+
+#define SILC_FORMAT_VERSION 1
+#define SILC_ALIGN          8
+#define SILC_BYTE_ORDER     0x01020304u
+
+typedef struct {
+    char     magic[4];     /* "SILC"                                   */
+    uint32_t version;      /* SILC_FORMAT_VERSION                      */
+    uint32_t byte_order;   /* SILC_BYTE_ORDER as the writer stored it  */
+    uint32_t value_size;   /* sizeof(Value) of the writer              */
+    uint32_t flags;        /* bit 0: optimised, bit 1: checked         */
+    uint32_t slot_count, max_stack;
+    uint32_t code_len, const_count, loc_count;
+    uint64_t code_off, const_off, loc_off;
+    uint64_t check;        /* bytecode_check() of the arrays           */
+} SilcHeader;
+
+/* Does an array of count size-byte items at off fit in a len-byte file? */
+static int silc_section(uint64_t off, uint32_t count, size_t size, size_t len) {
+    return off % SILC_ALIGN == 0 && off <= len && count <= (len - off) / size;
+}
+
+/*
+ * Point *bc into the len-byte .silc image at data, which must be
+ * SILC_ALIGN-aligned.  bc borrows the image, so it must not be passed
+ * to bytecode_free().  Returns 0 if the image is well formed and its
+ * bytecode verifies.
+ */
+static int silc_open(const void *data, size_t len, Bytecode *bc) {
+    const SilcHeader *h    = (const SilcHeader *)data;
+    const char       *base = (const char *)data;
+
+    /* Each slot is written, and each stack entry pushed, by its own
+       instruction, so neither count can exceed code_len */
+    memset(bc, 0, sizeof(*bc));
+    if ((uintptr_t)data % SILC_ALIGN != 0 || len < sizeof(SilcHeader) ||
+        memcmp(h->magic, "SILC", 4) != 0 || h->version != SILC_FORMAT_VERSION ||
+        h->byte_order != SILC_BYTE_ORDER || h->value_size != sizeof(Value) ||
+        h->code_len > INT_MAX || h->const_count > INT_MAX || h->loc_count > INT_MAX ||
+        h->slot_count > h->code_len || h->max_stack > h->code_len ||
+        !silc_section(h->code_off, h->code_len, sizeof(Instr), len) ||
+        !silc_section(h->const_off, h->const_count, sizeof(Value), len) ||
+        !silc_section(h->loc_off, h->loc_count, sizeof(SrcLoc), len))
+        return -1;
+
+    bc->code        = (Instr *)(base + h->code_off);
+    bc->consts      = (Value *)(base + h->const_off);
+    bc->locs        = (SrcLoc *)(base + h->loc_off);
+    bc->code_len    = bc->code_cap  = (int)h->code_len;
+    bc->const_count = bc->const_cap = (int)h->const_count;
+    bc->loc_count   = bc->loc_cap   = (int)h->loc_count;
+    bc->slot_count  = (int)h->slot_count;
+    bc->max_stack   = (int)h->max_stack;
+    bc->checked     = (h->flags & 2u) != 0;
+    return bytecode_check(bc) == h->check && bytecode_verify(bc) ? 0 : -1;
+}
+
+/*
+ * run_compiled() - Runs a .silc image on the VM, or natively with the
+ * jit engine.  Returns 1 if any error was reported, else 0.
+ */
+static int run_compiled(Interp *in, const void *data, size_t len) {
+    retained_free(in->retained);
+    in->retained   = NULL;
+    in->had_error  = 0;
+    in->lex_error  = 0;
+    in->diag_count = 0;
+
+    Bytecode bc;
+    if (silc_open(data, len, &bc) != 0) {
+        diag(in, DIAG_ERROR, 0, 0, "not a compiled program for this version and machine, "
+                                   "or damaged");
+        in->had_error = 1;
+        return 1;
+    }
+    /* A program that opens has passed bytecode_verify(): nothing is
+       left to check without running it */
+    if (in->opt.check_only) return 0;
+
+    slots_reserve(in, bc.slot_count);
+    if (bc.slot_count > 0) memset(in->slot_values, 0, bc.slot_count * sizeof(Value));
+
+    STAT_BEGIN(in);
+    run_bytecode(in, &bc);
+    STAT_END(in, PHASE_EXECUTE);
+    output_flush(in);
+    return in->had_error;
+}
+
+/* ======================== INCREMENTAL RE-RUNS ======================== */
+/*
+ * run_retained() runs a program like the ast engine but keeps it: the
+ * AST, its dependency graph, each statement's value and the runtime
+ * diagnostics it produced.  rerun_decl() then replaces one
+ * declaration's initialiser with a literal and re-evaluates only what
+ * is downstream of it, lowest statement first so every input is
+ * already up to date.  A statement whose value comes out unchanged does
+ * not dirty its own dependents.
+ *
+ * Each run reports exactly what running the patched source from scratch
+ * would.  print() values and diagnostics of the statements that were
+ * not re-evaluated are replayed from the record.  Constant folding
+ * still applies, but common subexpressions are not shared: a temporary
+ * saved inside a patched initialiser would otherwise be lost with it.
+ */
+
+/* A runtime diagnostic recorded against its statement */
+typedef struct RunDiag {
+    DiagKind        kind;
+    int             line, col;
+    char           *msg;
+    struct RunDiag *next;
+} RunDiag;
+
+struct Retained {
+    Arena     arena;   /* the program's Nodes and Stmts             */
+    DepGraph  g;
+    Value    *values;  /* per statement: value of its expression    */
+    RunDiag **diags;   /* per statement: its diagnostics, in order  */
+    int      *queued;  /* per statement: serial of the last re-run
+                          that queued it                             */
+    int      *heap;    /* statements to re-evaluate (min-heap)       */
+    int       heap_len;
+    int       serial;
+};
+
+static void run_diags_free(RunDiag *d) {
+    while (d) {
+        RunDiag *next = d->next;
+        free(d->msg);
+        free(d);
+        d = next;
+    }
+}
+
+static void retained_free(Retained *r) {
+    if (!r) return;
+    for (int i = 0; i < r->g.n; i++) run_diags_free(r->diags[i]);
+    depgraph_free(&r->g);
+    arena_free(&r->arena);
+    free(r->values);
+    free(r->diags);
+    free(r->queued);
+    free(r->heap);
+    free(r);
+}
+
+/* Append a diagnostic to the list whose tail pointer is *user */
+static void retained_capture(void *user, DiagKind kind, int line, int col, const char *msg) {
+    RunDiag ***tail = (RunDiag ***)user;
+    RunDiag   *d    = (RunDiag *)xmalloc(sizeof(RunDiag));
+    d->kind = kind;
+    d->line = line;
+    d->col  = col;
+    d->msg  = (char *)xmalloc(strlen(msg) + 1);
+    strcpy(d->msg, msg);
+    d->next = NULL;
+    **tail  = d;
+    *tail   = &d->next;
+}
+
+/* Evaluate statement i, replacing its recorded value and diagnostics */
+static void retained_eval(Interp *in, Retained *r, int i) {
+    const Stmt  *s    = r->g.stmts[i];
+    InterpDiagFn fn   = in->diag_fn;
+    void        *user = in->diag_user;
+    RunDiag    **tail = &r->diags[i];
+
+    run_diags_free(r->diags[i]);
+    r->diags[i] = NULL;
+
+    int          limit = in->opt.max_errors;
+
+    /* The record is counted against max_errors when it is emitted */
+    in->diag_fn        = retained_capture;
+    in->diag_user      = &tail;
+    in->opt.max_errors = 0;
+    Value v = eval_expr(in, s->expr);
+    in->opt.max_errors = limit;
+    in->diag_fn        = fn;
+    in->diag_user      = user;
+
+    r->values[i] = v;
+    if (s->kind == S_DECL) in->slot_values[s->slot] = v;
+}
+
+/* Report the recorded program run in source order */
+static int retained_emit(Interp *in, const Retained *r) {
+    in->had_error  = 0;
+    in->diag_count = 0;
+    for (int i = 0; i < r->g.n; i++) {
+        for (const RunDiag *d = r->diags[i]; d; d = d->next) {
+            diag(in, d->kind, d->line, d->col, "%s", d->msg);
+            in->had_error = 1;
+        }
+        if (r->g.stmts[i]->kind == S_PRINT && !in->had_error)
+            output_value(in, r->values[i]);
+    }
+    output_flush(in);
+    return in->had_error;
+}
+
+/* Parse and run a program, keeping it for rerun_decl() */
+static int run_retained(Interp *in, const char *src, size_t len) {
+    retained_free(in->retained);
+    in->retained = NULL;
+
+    parser_init(in, src, len);
+    sym_reset(in);
+
+    Program prog;
+    parse_program(in, &prog);
+    if (!in->had_error && in->opt.optimise) fold_program(in, &prog);
+    if (in->had_error || in->lex_error) {
+        output_flush(in);
+        arena_reset(&in->ast_arena);
+        return 1;
+    }
+    slots_reserve(in, prog.slot_count);
+
+    /* The program now belongs to r; the context gets a fresh arena */
+    Retained *r = (Retained *)xmalloc(sizeof(Retained));
+    memset(r, 0, sizeof(*r));
+    r->arena = in->ast_arena;
+    memset(&in->ast_arena, 0, sizeof(in->ast_arena));
+
+    depgraph_build(&r->g, &prog);
+    int n = r->g.n;
+    r->values = (Value *)xmalloc((n + 1) * sizeof(Value));
+    r->diags  = (RunDiag **)xmalloc((n + 1) * sizeof(RunDiag *));
+    r->queued = (int *)xmalloc((n + 1) * sizeof(int));
+    r->heap   = (int *)xmalloc((n + 1) * sizeof(int));
+    memset(r->diags, 0, (n + 1) * sizeof(RunDiag *));
+    memset(r->queued, 0, (n + 1) * sizeof(int));
+
+    for (int i = 0; i < n; i++) retained_eval(in, r, i);
+    in->retained = r;
+    return retained_emit(in, r);
+}
+
+static void heap_push(Retained *r, int i) {
+    int k = r->heap_len++;
+    while (k > 0 && r->heap[(k - 1) / 2] > i) {
+        r->heap[k] = r->heap[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    r->heap[k] = i;
+}
+
+static int heap_pop(Retained *r) {
+    int top  = r->heap[0];
+    int last = r->heap[--r->heap_len];
+    int k    = 0;
+    for (;;) {
+        int c = 2 * k + 1;
+        if (c >= r->heap_len) break;
+        if (c + 1 < r->heap_len && r->heap[c + 1] < r->heap[c]) c++;
+        if (r->heap[c] >= last) break;
+        r->heap[k] = r->heap[c];
+        k = c;
+    }
+    r->heap[k] = last;
+    return top;
+}
+
+/*
+ * Re-run the retained program as if `name` had been declared with the
+ * literal value.  Returns 0 or 1 like run_retained(), or -1 if there is
+ * no retained program, it does not declare name, or value does not fit.
+ */
+static int rerun_decl(Interp *in, const char *name, long long value) {
+    Retained *r = in->retained;
+    if (!r || value < VALUE_MIN || value > VALUE_MAX) return -1;
+
+    Variable *var = sym_lookup(in, intern(in, name, (int)strlen(name)));
+    if (!var) return -1;
+    int   i = r->g.decl_of[var->slot];
+    Stmt *s = r->g.stmts[i];
+
+    /* --- Patch the initialiser; a literal one is reused as is --- */
+    if (s->expr->kind != N_NUM) {
+        Node *lit = (Node *)arena_alloc(&r->arena, sizeof(Node));
+        lit->kind = N_NUM;
+        lit->line = s->expr->line;
+        lit->col  = s->expr->col;
+        lit->lhs  = lit->rhs = NULL;
+        s->expr   = lit;
+    }
+    s->expr->value = (Value)value;
+
+    /* --- Re-evaluate downstream statements until values settle --- */
+    r->serial++;
+    r->queued[i] = r->serial;
+    heap_push(r, i);
+    while (r->heap_len > 0) {
+        int   k   = heap_pop(r);
+        Value old = r->values[k];
+        retained_eval(in, r, k);
+        if (r->values[k] == old && k != i) continue;
+
+        for (int e = r->g.dep_start[k]; e < r->g.dep_start[k + 1]; e++) {
+            int d = r->g.deps[e];
+            if (r->queued[d] != r->serial) {
+                r->queued[d] = r->serial;
+                heap_push(r, d);
+            }
+        }
+    }
+    return retained_emit(in, r);
+}
+
+/* ======================== LIBRARY INTERFACE ======================== */
+/* The entry points declared in parser.h */
+
+Interp *interp_create(const InterpOptions *opt) {
+    Interp *in = (Interp *)xmalloc(sizeof(Interp));
+    interp_init(in, stdout, stderr);
+    if (opt) in->opt = *opt;
+    return in;
+}
+
+void interp_set_output(Interp *in, InterpOutputFn fn, void *user) {
+    in->out_fn   = fn;
+    in->out_user = user;
+}
+
+void interp_set_diagnostics(Interp *in, InterpDiagFn fn, void *user) {
+    in->diag_fn   = fn;
+    in->diag_user = user;
+}
+
+void interp_cache_stats(const Interp *in, InterpCacheStats *stats) {
+    if (in->cache)
+        *stats = in->cache->stats;
+    else
+        memset(stats, 0, sizeof(*stats));
+}
+
+int interp_run_string(Interp *in, const char *src, size_t len) {
+    return run_source(in, src, len);
+}
+
+int interp_run_compiled(Interp *in, const void *data, size_t len) {
+    return run_compiled(in, data, len);
+}
+
+int interp_run_retained(Interp *in, const char *src, size_t len) {
+    return run_retained(in, src, len);
+}
+
+int interp_rerun(Interp *in, const char *name, long long value) {
+    return rerun_decl(in, name, value);
+}
+
+void interp_destroy(Interp *in) {
+    if (!in) return;
+    interp_release(in);
+    free(in);
+}
+
+/* bench.c builds without main() but times read_file() */
+#if !defined(PARSER_NO_MAIN) || defined(PARSER_BENCH)
+
+/* ======================== FILE READING ======================== */
+/*
+ * Regular files are mapped read-only and lexed in place, so there is no
+ * copy of the input and a run starts without reading the whole file.
+ * Anything that cannot be mapped (stdin given as "-", pipes, terminals)
+ * is read in fixed-size chunks into the context's read buffer instead,
+ * which later reads reuse and interp_release() frees.
+ */
+
+#define READ_CHUNK (64 * 1024)
+
+typedef struct {
+    const char *data;   /* source text (not NUL-terminated)  */
+    size_t      length;
+    void       *map;    /* mmap'd region, or NULL             */
+    size_t      map_size;
+} SourceFile;
+
+/* Make room for more input after len bytes of the read buffer */
+static char *read_room(Interp *in, size_t len) {
+    if (in->read_cap - len < READ_CHUNK) {
+        while (in->read_cap - len < READ_CHUNK)
+            in->read_cap = in->read_cap ? in->read_cap * 2 : 2 * READ_CHUNK;
+        in->read_buf = (char *)xrealloc(in->read_buf, in->read_cap);
+    }
+    return in->read_buf + len;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+/* Read everything from fd into the read buffer */
+static int read_stream(Interp *in, int fd, const char *path, SourceFile *sf) {
+    size_t len = 0;
+    for (;;) {
+        ssize_t n = read(fd, read_room(in, len), READ_CHUNK);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            diag(in, DIAG_ERROR, 0, 0, "cannot read file '%s'", path);
+            return -1;
+        }
+        len += (size_t)n;
+    }
+
+    sf->data   = in->read_buf;
+    sf->length = len;
+    return 0;
+}
+
+/*
+ * read_file() - Makes the contents of a file ("-" for stdin) available
+ * in *sf.  Returns 0 on success, -1 on failure.
+ */
+static int read_file(Interp *in, const char *path, SourceFile *sf) {
+    memset(sf, 0, sizeof(*sf));
+    sf->data = "";
+
+    if (strcmp(path, "-") == 0) return read_stream(in, STDIN_FILENO, "<stdin>", sf);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        diag(in, DIAG_ERROR, 0, 0, "cannot open file '%s'", path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            return 0;
+        }
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            close(fd);
+            sf->data     = (const char *)map;
+            sf->length   = (size_t)st.st_size;
+            sf->map      = map;
+            sf->map_size = (size_t)st.st_size;
+            return 0;
+        }
+    }
+
+    int rc = read_stream(in, fd, path, sf);
+    close(fd);
+    return rc;
+}
+
+static void close_source(SourceFile *sf) {
+    if (sf->map) munmap(sf->map, sf->map_size);
+    memset(sf, 0, sizeof(*sf));
+}
+
+#else /* no mmap: read through stdio */
+
+static int read_file(Interp *in, const char *path, SourceFile *sf) {
+    memset(sf, 0, sizeof(*sf));
+
+    int   is_stdin = strcmp(path, "-") == 0;
+    FILE *fp = is_stdin ? stdin : fopen(path, "rb");
+    if (!fp) {
+        diag(in, DIAG_ERROR, 0, 0, "cannot open file '%s'", path);
+        return -1;
+    }
+
+    size_t len = 0, n;
+    while ((n = fread(read_room(in, len), 1, READ_CHUNK, fp)) > 0) len += n;
+    int failed = ferror(fp);
+    if (!is_stdin) fclose(fp);
+    if (failed) {
+        diag(in, DIAG_ERROR, 0, 0, "cannot read file '%s'", path);
+        return -1;
+    }
+
+    sf->data   = in->read_buf;
+    sf->length = len;
+    return 0;
+}
+
+static void close_source(SourceFile *sf) {
+    memset(sf, 0, sizeof(*sf));
+}
+
+#endif
+
+#endif /* !PARSER_NO_MAIN || PARSER_BENCH */
+
+#ifndef PARSER_NO_MAIN
+
+/* ======================== DIAGNOSTIC OUTPUT ======================== */
+/*
+ * --diagnostics=json writes each diagnostic as one JSON object per line
+ * instead of the "<Kind> Error [line L, col C]: ..." text, for tools
+ * that check many files:
+ *
+ *     {"file":"a.sil","line":3,"col":9,"kind":"semantic","message":"..."}
+ *
+ * line and col are 0 when the diagnostic has none, and kind is one of
+ * error, lexical, syntax, semantic or runtime.  stderr is then fully
+ * buffered, and the closing "failed due to errors" line is left out.
+ */
+
+static int diag_json;  /* --diagnostics=json */
+
+/* Where json_diag() writes, and the file it reports */
+typedef struct {
+    FILE       *fp;
+    const char *path;
+} DiagSink;
+
+/* Write a JSON string literal */
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void json_diag(void *user, DiagKind kind, int line, int col, const char *msg) {
+    static const char *const kinds[] = {
+        "error", "lexical", "syntax", "semantic", "runtime"
+    };
+    const DiagSink *sink = (const DiagSink *)user;
+
+    fputs("{\"file\":", sink->fp);
+    json_string(sink->fp, sink->path);
+    fprintf(sink->fp, ",\"line\":%d,\"col\":%d,\"kind\":\"%s\",\"message\":",
+            line, col, kinds[kind]);
+    json_string(sink->fp, msg);
+    fputs("}\n", sink->fp);
+}
+
+/* ======================== STATISTICS REPORTS ======================== */
+/* Output for --stats and --trace (see STATISTICS) */
+
+#if SIL_STATS
+
+static int stats_report;   /* --stats */
+
+static const char *const stat_phase_names[PHASE_COUNT] = {
+    "read_file", "parse", "parse+execute", "optimise", "compile", "execute"
+};
+
+/* Print the --stats report for one run to the context's stderr */
+static void stats_print(Interp *in) {
+    const RunStats *s = &in->stats;
+    FILE           *f = in->err_fp;
+
+    fprintf(f, "--- stats: %s ---\n", s->file ? s->file : "<input>");
+    fprintf(f, "%-14s %10s %10s %12s\n", "phase", "time ms", "allocs", "bytes");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (!s->ran[p]) continue;
+        fprintf(f, "%-14s %10.3f %10lu %12lu\n", stat_phase_names[p],
+                s->secs[p] * 1e3, s->allocs[p], s->alloc_bytes[p]);
+    }
+    fprintf(f, "tokens %lu, symbol probes %lu, max expression depth %d, prints %lu\n",
+            s->tokens, s->sym_probes, s->max_depth, s->prints);
+}
+
+/* Write the collected trace events; returns 0 on success */
+static int trace_write(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (int i = 0; i < trace_log.count; i++) {
+        const TraceEvent *e = &trace_log.events[i];
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"sil\",\"ph\":\"X\",\"pid\":1,"
+                   "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"file\":",
+                i ? ",\n" : "", stat_phase_names[e->phase], e->tid, e->ts, e->dur);
+        json_string(f, e->file);
+        fprintf(f, "}}");
+        free(e->file);
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    free(trace_log.events);
+    trace_log.events = NULL;
+    trace_log.count  = trace_log.cap = 0;
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+#endif /* SIL_STATS */
+
+/* ======================== RUNNING FILES ======================== */
+
+/* The exit status of a run, adding the closing failure message */
+static int run_status(Interp *in) {
+    /* A lexical error has already been reported on its own */
+    int status = 0;
+    if (in->lex_error) {
+        status = 1;
+    } else if (in->had_error) {
+        if (!diag_json)
+            fprintf(in->err_fp, "\nParsing/execution failed due to errors above.\n");
+        status = 1;
+    }
+#if SIL_STATS
+    if (stats_report) stats_print(in);
+#endif
+    return status;
+}
+
+/*
+ * run_file() - Reads and runs one source file.  Returns the process
+ * exit status for that file.
+ */
+static int run_file(Interp *in, const char *path) {
+    SourceFile source;
+    DiagSink   sink = { in->err_fp, path };
+    if (diag_json) interp_set_diagnostics(in, json_diag, &sink);
+#if SIL_STATS
+    in->stats.file = path;
+#endif
+    STAT_BEGIN(in);
+    if (read_file(in, path, &source) != 0) return 1;
+    STAT_END(in, PHASE_READ);
+
+    /* A source file cannot start with "SILC": statements start with
+       "int" or "print" */
+    if (source.length >= 4 && memcmp(source.data, "SILC", 4) == 0)
+        run_compiled(in, source.data, source.length);
+    else
+        run_source(in, source.data, source.length);
+    close_source(&source);
+    return run_status(in);
+}
+
+/* ======================== PRECOMPILING ======================== */
+/* Writes .silc files for --compile (see PRECOMPILED PROGRAMS) */
+
+/* Write len bytes, then zeros up to the next SILC_ALIGN boundary */
+static int silc_put(FILE *fp, const void *data, size_t len, uint64_t *off) {
+    static const char zeros[SILC_ALIGN];
+    size_t pad = (SILC_ALIGN - (*off + len) % SILC_ALIGN) % SILC_ALIGN;
+    *off += len + pad;
+    return fwrite(data, 1, len, fp) == len && fwrite(zeros, 1, pad, fp) == pad;
+}
+
+/* Save bc as a .silc file; returns 0 on success */
+static int silc_write(const char *path, const Bytecode *bc, uint32_t flags) {
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    SilcHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "SILC", 4);
+    h.version     = SILC_FORMAT_VERSION;
+    h.byte_order  = SILC_BYTE_ORDER;
+    h.value_size  = sizeof(Value);
+    h.flags       = flags;
+    h.slot_count  = (uint32_t)bc->slot_count;
+    h.max_stack   = (uint32_t)bc->max_stack;
+    h.code_len    = (uint32_t)bc->code_len;
+    h.const_count = (uint32_t)bc->const_count;
+    h.loc_count   = (uint32_t)bc->loc_count;
+    h.code_off    = sizeof(SilcHeader);
+    h.const_off   = h.code_off + bc->code_len * sizeof(Instr);
+    h.const_off  += (SILC_ALIGN - h.const_off % SILC_ALIGN) % SILC_ALIGN;
+    h.loc_off     = h.const_off + bc->const_count * sizeof(Value);
+    h.loc_off    += (SILC_ALIGN - h.loc_off % SILC_ALIGN) % SILC_ALIGN;
+    h.check       = bytecode_check(bc);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return -1;
+    uint64_t off = 0;
+    int ok = silc_put(fp, &h, sizeof(h), &off) &&
+             silc_put(fp, bc->code, bc->code_len * sizeof(Instr), &off) &&
+             silc_put(fp, bc->consts, bc->const_count * sizeof(Value), &off) &&
+             silc_put(fp, bc->locs, bc->loc_count * sizeof(SrcLoc), &off);
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * compile_file() - Compiles one source file to a .silc file at out,
+ * with the context's optimise and checked options.  Nothing is written
+ * if the program has errors.  Returns the process exit status.
+ */
+static int compile_file(Interp *in, const char *path, const char *out) {
+    SourceFile source;
+    if (read_file(in, path, &source) != 0) return 1;
+
+    parser_init(in, source.data, source.length);
+    sym_reset(in);
+    Program prog;
+    parse_optimised(in, &prog);
+
+    int status = 1;
+    if (!in->had_error && !in->lex_error) {
+        Bytecode bc;
+        memset(&bc, 0, sizeof(bc));
+        compile_timed(in, &bc, &prog);
+        uint32_t flags = (in->opt.optimise ? 1u : 0u) | (in->opt.checked ? 2u : 0u);
+        if (silc_write(out, &bc, flags) == 0)
+            status = 0;
+        else
+            diag(in, DIAG_ERROR, 0, 0, "cannot write '%s'", out);
+        bytecode_free(&bc);
+    } else if (!in->lex_error && !diag_json) {
+        fprintf(in->err_fp, "\nCompilation failed due to errors above.\n");
+    }
+    arena_reset(&in->ast_arena);
+    close_source(&source);
+    return status;
+}
+
+/* ======================== BATCH MODE ======================== */
+/*
+ * run_batch() runs many source files on a pool of worker threads, each
+ * with its own Interp.  A file's stdout and stderr are captured in
+ * memory and written out by the main thread in the order the files were
+ * given, so output from different files never interleaves.  A worker
+ * keeps its Interp from file to file, so the buffers grown for one file
+ * are reused by the next.
+ */
+
+/* Point a reused context at the streams for the next file */
+static void batch_reset(Interp *in, FILE *out, FILE *err) {
+    in->out_fp  = out;
+    in->err_fp  = err;
+    in->diag_fn = NULL;
+#if SIL_STATS
+    memset(&in->stats, 0, sizeof(in->stats));
+#endif
+}
+
+typedef struct {
+    const char *path;
+    char       *out;      /* captured stdout */
+    size_t      out_len;
+    char       *err;      /* captured stderr */
+    size_t      err_len;
+    int         status;
+    int         done;
+} BatchJob;
+
+#if HAVE_PTHREADS
+
+typedef struct {
+    BatchJob       *jobs;
+    int             count;
+    int             next;  /* next job to hand out */
+    const InterpOptions *opt;
+    pthread_mutex_t lock;
+    pthread_cond_t  finished;
+} Batch;
+
+static void *batch_worker(void *arg) {
+    Batch  *b  = (Batch *)arg;
+    Interp *in = (Interp *)xmalloc(sizeof(Interp));
+    interp_init(in, NULL, NULL);
+    in->opt = *b->opt;
+
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        int i = b->next++;
+        pthread_mutex_unlock(&b->lock);
+        if (i >= b->count) break;
+
+        BatchJob *job = &b->jobs[i];
+        FILE *out = open_memstream(&job->out, &job->out_len);
+        FILE *err = open_memstream(&job->err, &job->err_len);
+        if (!out || !err) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        batch_reset(in, out, err);
+        int status = run_file(in, job->path);
+        fclose(out);
+        fclose(err);
+
+        pthread_mutex_lock(&b->lock);
+        job->status = status;
+        job->done   = 1;
+        pthread_cond_broadcast(&b->finished);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    interp_release(in);
+    free(in);
+    return NULL;
+}
+
+static int run_batch(const char **paths, int count, const InterpOptions *opt, int jobs) {
+    Batch b;
+    b.jobs  = (BatchJob *)xmalloc(count * sizeof(BatchJob));
+    b.count = count;
+    b.next  = 0;
+    b.opt   = opt;
+    memset(b.jobs, 0, count * sizeof(BatchJob));
+    for (int i = 0; i < count; i++) b.jobs[i].path = paths[i];
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.finished, NULL);
+
+    if (jobs > count) jobs = count;
+    pthread_t *threads = (pthread_t *)xmalloc(jobs * sizeof(pthread_t));
+    int        started = 0;
+    for (int t = 0; t < jobs; t++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, &b) != 0) break;
+        started++;
+    }
+    /* No threads available: run every file here first */
+    if (started == 0) batch_worker(&b);
+
+    /* Emit results in order as soon as each one is ready */
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        BatchJob *job = &b.jobs[i];
+        pthread_mutex_lock(&b.lock);
+        while (!job->done) pthread_cond_wait(&b.finished, &b.lock);
+        pthread_mutex_unlock(&b.lock);
+
+        fwrite(job->out, 1, job->out_len, stdout);
+        fflush(stdout);
+        fwrite(job->err, 1, job->err_len, stderr);
+        fflush(stderr);
+        free(job->out);
+        free(job->err);
+        if (job->status != 0) status = 1;
+    }
+
+    for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.finished);
+    free(threads);
+    free(b.jobs);
+    return status;
+}
+
+#else /* no threads: run the files one after another */
+
+static int run_batch(const char **paths, int count, const InterpOptions *opt, int jobs) {
+    Interp *in = (Interp *)xmalloc(sizeof(Interp));
+    int status = 0;
+    (void)jobs;
+    interp_init(in, stdout, stderr);
+    in->opt = *opt;
+    for (int i = 0; i < count; i++) {
+        batch_reset(in, stdout, stderr);
+        if (run_file(in, paths[i]) != 0) status = 1;
+    }
+    interp_release(in);
+    free(in);
+    return status;
+}
+
+#endif /* HAVE_PTHREADS */
+
+/* ======================== SERVER MODE ======================== */
+/*
+ * --serve keeps one session open and answers requests as they arrive:
+ * on stdin and stdout, or with --serve=PATH on each connection to a
+ * Unix socket at PATH (one session per connection, each on its own
+ * thread).  Every line received is a request of zero or more complete
+ * statements, run by the direct engine against the session's
+ * variables, which persist from one request to the next.
+ *
+ * The response to a request is its print() values and diagnostics, in
+ * order, one per line, followed by "ok" or "error".  A diagnostic's
+ * "line" is the request's number in the session, counting from 1.
+ * A declaration with errors has no effect, so that it can be sent
+ * again, corrected.  Requests may be pipelined: the responses to all
+ * the complete lines received so far are written out together, before
+ * the server waits for more input.
+ */
+
+/* Diagnostics go to the response, after the print() values before them */
+static void serve_diag(void *user, DiagKind kind, int line, int col, const char *msg) {
+    Interp *in = (Interp *)user;
+    output_drain(in);
+    diag_write(in->out_fp, kind, line, col, msg);
+}
+
+static void serve_request(Interp *in, const char *src, size_t len, int number) {
+    parser_init(in, src, len);
+    in->lex_line = number;
+    run_program(in);
+    arena_reset(&in->ast_arena);
+    output_drain(in);
+    fputs(in->had_error || in->lex_error ? "error\n" : "ok\n", in->out_fp);
+}
+
+/* Run a session reading requests from fd and answering on out */
+static void serve_session(const InterpOptions *opt, int fd, FILE *out) {
+    Interp *in = (Interp *)xmalloc(sizeof(Interp));
+    interp_init(in, out, out);
+    in->opt        = *opt;
+    in->opt.engine = ENGINE_DIRECT;
+    in->session    = 1;
+    interp_set_diagnostics(in, serve_diag, in);
+
+    char  *buf = NULL;
+    size_t len = 0, cap = 0;
+    int    number = 0;
+    for (;;) {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 64 * 1024;
+            buf = (char *)xrealloc(buf, cap);
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+
+        /* Answer every complete line, then send the answers at once */
+        size_t start = 0;
+        const char *nl;
+        while ((nl = (const char *)memchr(buf + start, '\n', len - start)) != NULL) {
+            serve_request(in, buf + start, (size_t)(nl - buf) - start, ++number);
+            start = (size_t)(nl - buf) + 1;
+        }
+        memmove(buf, buf + start, len - start);
+        len -= start;
+        if (fflush(out) != 0) break;  /* the client has gone */
+    }
+    if (len > 0) {
+        serve_request(in, buf, len, ++number);
+        fflush(out);
+    }
+
+    free(buf);
+    interp_release(in);
+    free(in);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+typedef struct {
+    const InterpOptions *opt;
+    int                  fd;
+} ServeConn;
+
+static void *serve_conn(void *arg) {
+    ServeConn *c   = (ServeConn *)arg;
+    FILE      *out = fdopen(dup(c->fd), "w");
+    if (out) {
+        serve_session(c->opt, c->fd, out);
+        fclose(out);
+    }
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+/* Accept connections on a Unix socket at path until an error occurs */
+static int serve_socket(const InterpOptions *opt, const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path '%s' is too long\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);  /* a socket left by an earlier server */
+    if (s < 0 || bind(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s, 64) != 0) {
+        fprintf(stderr, "Error: cannot listen on '%s'\n", path);
+        if (s >= 0) close(s);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);  /* a client hanging up is not fatal */
+
+    for (;;) {
+        int fd = accept(s, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        ServeConn *c = (ServeConn *)xmalloc(sizeof(ServeConn));
+        c->opt = opt;
+        c->fd  = fd;
+#if HAVE_PTHREADS
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, serve_conn, c) == 0) {
+            pthread_detach(tid);
+            continue;
+        }
+#endif
+        serve_conn(c);  /* no thread: serve it before accepting again */
+    }
+    fprintf(stderr, "Error: cannot accept connections on '%s'\n", path);
+    close(s);
+    return 1;
+}
+
+#endif
+
+#endif /* PARSER_NO_MAIN */
+
+/* fuzz.c builds without main() but compares --rows with the engines */
+#if !defined(PARSER_NO_MAIN) || defined(PARSER_FUZZ)
+
+/* ======================== COLUMNAR EXECUTION ======================== */
+/*
+ * --rows=FILE runs one program over every row of a table at once.
+ * The first line of FILE names input variables, separated by commas;
+ * each later line holds one row's values for them, or with
+ * --binary-input the header is followed by each column's values in
+ * turn, as raw native-endian values.  A row runs as if the program's
+ * declaration of each named variable had been `int name = value;`
+ * with the row's value.
+ *
+ * The program is compiled once and its bytecode runs over blocks of
+ * up to COL_BLOCK rows, every slot and stack entry holding one value
+ * per row of the block.  + - and * run on SIMD vectors of rows; a
+ * division checks its divisors for zero as a per-row mask.  A row in
+ * which an operator fails gets a Runtime Error naming the row, and its
+ * later print() values are left out, as in a run of its own.
+ *
+ * Each row's print() values are written on one line, separated by
+ * commas, with an empty field for a value left out.  --binary-output
+ * writes each row's values raw instead, 0 standing in for one left out.
+ */
+
+#define COL_BLOCK  1024               /* rows per block, at most      */
+#define COL_LANES  16                 /* blocks are multiples of this */
+#define COL_BUDGET (16 * 1024 * 1024) /* bytes of block data, roughly */
+
+enum { COL_OK, COL_DIV_ZERO, COL_OVERFLOW };
+
+typedef struct {
+    int     count;   /* columns               */
+    size_t  rows;
+    char  **names;
+    Value **values;  /* values[column][row]   */
+} RowTable;
+
+/* One stack entry: a value per row, or one value for every row */
+typedef struct {
+    const Value *v;  /* NULL for a constant */
+    Value        c;
+} ColEntry;
+
+/* An operator failing in one row, reported once its block is done */
+typedef struct {
+    size_t row;
+    int    seq;  /* order within the block       */
+    int    loc;  /* bc->locs[]                   */
+    int    why;  /* COL_DIV_ZERO or COL_OVERFLOW */
+} ColFault;
+
+typedef struct {
+    const Bytecode *bc;
+    int             block;    /* rows per block                        */
+    int             n;        /* rows in this block                    */
+    size_t          base;     /* first row of this block               */
+    const Value   **slot;     /* per slot: its values in this block    */
+    Value          *store;    /* slots' own values, block per slot     */
+    ColEntry       *stack;    /* operand stack, max_stack entries      */
+    Value          *scratch;  /* block per stack depth                 */
+    Value          *printed;  /* block per print() statement           */
+    unsigned char  *shown;    /* per printed value: no error before it */
+    unsigned char  *failed;   /* per row: an error so far              */
+    unsigned char  *lane;     /* per row: the COL_* outcome of the
+                                 current operator                      */
+    ColFault       *faults;
+    int             fault_count, fault_cap;
+} ColRun;
+
+static void free_rows(RowTable *t) {
+    for (int k = 0; k < t->count; k++) {
+        free(t->names[k]);
+        free(t->values[k]);
+    }
+    free(t->names);
+    free(t->values);
+    memset(t, 0, sizeof(*t));
+}
+
+/* Record the rows in which the last operator failed */
+static void col_faults(ColRun *r, int loc) {
+    for (int i = 0; i < r->n; i++) {
+        if (r->lane[i] == COL_OK) continue;
+        if (r->fault_count == r->fault_cap) {
+            r->fault_cap = r->fault_cap ? r->fault_cap * 2 : 64;
+            r->faults = (ColFault *)xrealloc(r->faults, r->fault_cap * sizeof(ColFault));
+        }
+        r->faults[r->fault_count] = (ColFault){ r->base + i, r->fault_count, loc, r->lane[i] };
+        r->fault_count++;
+        r->failed[i] = 1;
+    }
+}
+
+static int col_fault_cmp(const void *a, const void *b) {
+    const ColFault *x = (const ColFault *)a, *y = (const ColFault *)b;
+    if (x->row != y->row) return x->row < y->row ? -1 : 1;
+    return x->seq - y->seq;
+}
+
+/* e's values, written out into buf if it is a constant */
+static const Value *col_values(const ColRun *r, const ColEntry *e, Value *buf) {
+    if (e->v) return e->v;
+    for (int i = 0; i < r->n; i++) buf[i] = e->c;
+    return buf;
+}
+
+/*
+ * The wrapping operators run on whole vectors with GCC/Clang vector
+ * types: 16 bytes, or 32 with -mavx2.  Blocks and columns are padded
+ * to COL_LANES rows, so the last vector of a short block stays inside
+ * its buffers; what it computes past the block's rows is never read.
+ */
+#if defined(__GNUC__)
+#ifdef __AVX2__
+typedef UValue ColVec __attribute__((vector_size(32)));
+#else
+typedef UValue ColVec __attribute__((vector_size(16)));
+#endif
+#define COL_STEP ((int)(sizeof(ColVec) / sizeof(Value)))
+
+static ColVec col_load(const Value *p) {
+    ColVec v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void col_put(Value *p, ColVec v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+/* One loop per operand shape, a constant broadcast to every lane */
+#define COL_WRAP(OP)                                                                \
+    if (!b->v) {                                                                    \
+        ColVec y = (ColVec){ 0 } + (UValue)b->c;                                    \
+        for (int i = 0; i < nv; i += COL_STEP) col_put(out + i, col_load(x + i) OP y); \
+    } else if (!a->v) {                                                             \
+        ColVec c = (ColVec){ 0 } + (UValue)a->c;                                    \
+        for (int i = 0; i < nv; i += COL_STEP) col_put(out + i, c OP col_load(b->v + i)); \
+    } else {                                                                        \
+        for (int i = 0; i < nv; i += COL_STEP)                                      \
+            col_put(out + i, col_load(x + i) OP col_load(b->v + i));                \
+    }
+#else
+#define COL_WRAP(OP)                                                          \
+    if (!b->v) {                                                              \
+        UValue y = (UValue)b->c;                                              \
+        for (int i = 0; i < nv; i++) out[i] = (Value)((UValue)x[i] OP y);     \
+    } else if (!a->v) {                                                       \
+        UValue c = (UValue)a->c;                                              \
+        for (int i = 0; i < nv; i++) out[i] = (Value)(c OP (UValue)b->v[i]);  \
+    } else {                                                                  \
+        for (int i = 0; i < nv; i++)                                          \
+            out[i] = (Value)((UValue)x[i] OP (UValue)b->v[i]);                \
+    }
+#endif
+
+/* Apply a binary operator to a block; the result replaces *a in out */
+static void col_binary(ColRun *r, const Instr *ip, ColEntry *a, const ColEntry *b, Value *out) {
+    static const NodeKind checked_kind[] = { N_ADD, N_SUB, N_MUL, N_DIV };
+    int          n  = r->n;
+    int          nv = (n + COL_LANES - 1) & ~(COL_LANES - 1);
+    const Value *x  = a->v;
+    if (!x && !b->v) x = col_values(r, a, out);  /* left unfolded */
+
+    switch (ip->op) {
+        case OP_ADD: COL_WRAP(+); break;
+        case OP_SUB: COL_WRAP(-); break;
+        case OP_MUL: COL_WRAP(*); break;
+        case OP_DIV: {
+            if (!x) x = col_values(r, a, out);
+            if (!b->v && b->c != 0) {
+                for (int i = 0; i < n; i++) out[i] = arith_div(x[i], b->c);
+                break;
+            }
+            const Value  *y   = b->v;  /* or a constant zero: every row fails */
+            unsigned char any = 0;
+            for (int i = 0; i < n; i++) {
+                r->lane[i] = !y || y[i] == 0 ? COL_DIV_ZERO : COL_OK;
+                any |= r->lane[i];
+            }
+            for (int i = 0; i < n; i++) out[i] = r->lane[i] ? 0 : arith_div(x[i], y[i]);
+            if (any) col_faults(r, ip->arg);
+            break;
+        }
+        default: {
+            /* Checked: a row that fails yields 0, as in eval_binary() */
+            NodeKind      kind = checked_kind[ip->op - OP_ADDC];
+            unsigned char any  = 0;
+            for (int i = 0; i < n; i++) {
+                Value l = x ? x[i] : a->c, d = b->v ? b->v[i] : b->c, v = 0;
+                if (kind == N_DIV && d == 0)
+                    r->lane[i] = COL_DIV_ZERO;
+                else
+                    r->lane[i] = arith_checked(kind, l, d, &v) != 0 ? COL_OVERFLOW : COL_OK;
+                any |= r->lane[i];
+                out[i] = r->lane[i] ? 0 : v;
+            }
+            if (any) col_faults(r, ip->arg);
+            break;
+        }
+    }
+    a->v = out;
+}
+
+/* Give a slot the values of e for this block */
+static void col_store(ColRun *r, int slot, const ColEntry *e) {
+    Value *dst = r->store + (size_t)slot * r->block;
+    if (e->v == r->slot[slot]) return;  /* an input column, already in place */
+    if (e->v)
+        memcpy(dst, e->v, r->n * sizeof(Value));
+    else
+        col_values(r, e, dst);
+}
+
+/* Run the program over the current block */
+static void col_block(ColRun *r) {
+    const Bytecode *bc    = r->bc;
+    ColEntry       *stack = r->stack;
+    int             sp = 0, p = 0;
+
+    memset(r->failed, 0, r->n);
+    for (const Instr *ip = bc->code;; ip++) {
+        switch (ip->op) {
+            case OP_PUSH:
+                stack[sp].v = NULL;
+                stack[sp].c = bc->consts[ip->arg];
+                sp++;
+                break;
+            case OP_LOAD:
+                stack[sp++].v = r->slot[ip->arg];
+                break;
+            case OP_STORE:
+                col_store(r, ip->arg, &stack[--sp]);
+                break;
+            case OP_TEE:
+                col_store(r, ip->arg, &stack[sp - 1]);
+                break;
+            case OP_PRINT: {
+                size_t         at    = (size_t)p++ * r->block;
+                unsigned char *shown = r->shown + at;
+                if (stack[sp - 1].v)
+                    memcpy(r->printed + at, stack[sp - 1].v, r->n * sizeof(Value));
+                else
+                    col_values(r, &stack[sp - 1], r->printed + at);
+                for (int i = 0; i < r->n; i++) shown[i] = !r->failed[i];
+                sp--;
+                break;
+            }
+            case OP_HALT:
+                return;
+            default:
+                sp--;
+                col_binary(r, ip, &stack[sp - 1], &stack[sp],
+                           r->scratch + (size_t)(sp - 1) * r->block);
+                break;
+        }
+    }
+}
+
+/* Write the block's rows of print() values */
+static void col_output(Interp *in, const ColRun *r, int prints) {
+    for (int i = 0; i < r->n; i++) {
+        for (int p = 0; p < prints; p++) {
+            size_t k = (size_t)p * r->block + i;
+            Value  v = r->shown[k] ? r->printed[k] : 0;
+            if (OUT_BUF_SIZE - in->out_len < 32) output_drain(in);
+            if (in->opt.out_binary) {
+                memcpy(in->out_buf + in->out_len, &v, sizeof(v));
+                in->out_len += sizeof(v);
+                continue;
+            }
+            if (p > 0) in->out_buf[in->out_len++] = ',';
+            if (r->shown[k]) {
+                char  tmp[24];
+                char *start = format_int(tmp + sizeof(tmp), v);
+                memcpy(in->out_buf + in->out_len, start, (size_t)(tmp + sizeof(tmp) - start));
+                in->out_len += (size_t)(tmp + sizeof(tmp) - start);
+            }
+        }
+        if (prints > 0 && !in->opt.out_binary) {
+            if (OUT_BUF_SIZE - in->out_len < 1) output_drain(in);
+            in->out_buf[in->out_len++] = '\n';
+        }
+    }
+}
+
+/* Run compiled code over every row; slots[k] is column k's variable */
+static void col_execute(Interp *in, const Bytecode *bc, const RowTable *t, const int *slots) {
+    int prints = 0;
+    for (int k = 0; k < bc->code_len; k++) prints += bc->code[k].op == OP_PRINT;
+
+    /* As many rows per block as fit the budget, in whole vectors */
+    size_t row_bytes = (size_t)(bc->slot_count + bc->max_stack + prints) * sizeof(Value) +
+                       (size_t)prints + 2;
+    size_t block     = COL_BUDGET / row_bytes;
+    if (block > COL_BLOCK) block = COL_BLOCK;
+    block = block < COL_LANES ? COL_LANES : block & ~(size_t)(COL_LANES - 1);
+
+    ColRun r;
+    memset(&r, 0, sizeof(r));
+    r.bc      = bc;
+    r.block   = (int)block;
+    r.slot    = (const Value **)xmalloc((bc->slot_count + 1) * sizeof(Value *));
+    r.store   = (Value *)xmalloc((bc->slot_count + 1) * block * sizeof(Value));
+    r.stack   = (ColEntry *)xmalloc((bc->max_stack + 1) * sizeof(ColEntry));
+    r.scratch = (Value *)xmalloc((bc->max_stack + 1) * block * sizeof(Value));
+    r.printed = (Value *)xmalloc((prints + 1) * block * sizeof(Value));
+    r.shown   = (unsigned char *)xmalloc((prints + 1) * block);
+    r.failed  = (unsigned char *)xmalloc(block);
+    r.lane    = (unsigned char *)xmalloc(block);
+    memset(r.store, 0, (bc->slot_count + 1) * block * sizeof(Value));
+    memset(r.scratch, 0, (bc->max_stack + 1) * block * sizeof(Value));
+    for (int s = 0; s < bc->slot_count; s++) r.slot[s] = r.store + (size_t)s * block;
+
+    for (size_t base = 0; base < t->rows; base += block) {
+        r.base        = base;
+        r.n           = (int)(t->rows - base < block ? t->rows - base : block);
+        r.fault_count = 0;
+        for (int k = 0; k < t->count; k++) r.slot[slots[k]] = t->values[k] + base;
+        col_block(&r);
+
+        /* Each row's errors in the order a run of its own reports them */
+        if (r.fault_count > 0) {
+            qsort(r.faults, r.fault_count, sizeof(ColFault), col_fault_cmp);
+            for (int f = 0; f < r.fault_count; f++) {
+                const ColFault *e = &r.faults[f];
+                diag(in, DIAG_RUNTIME, bc->locs[e->loc].line, bc->locs[e->loc].col,
+                     "%s in row %zu", e->why == COL_OVERFLOW ? "integer overflow" : "division by zero",
+                     e->row + 1);
+            }
+            in->had_error = 1;
+        }
+        col_output(in, &r, prints);
+    }
+
+    free(r.slot);
+    free(r.store);
+    free(r.stack);
+    free(r.scratch);
+    free(r.printed);
+    free(r.shown);
+    free(r.failed);
+    free(r.lane);
+    free(r.faults);
+}
+
+/*
+ * Point each column's declaration at the column: it becomes
+ * `int name = name;`, which col_store() knows to leave in place.
+ * Returns the columns' slots, or NULL if a column names no variable.
+ */
+static int *col_bind(Interp *in, Program *prog, const RowTable *t) {
+    int           *slots = (int *)xmalloc(t->count * sizeof(int));
+    unsigned char *input = (unsigned char *)xmalloc(prog->slot_count + 1);
+    memset(input, 0, prog->slot_count + 1);
+
+    for (int k = 0; k < t->count; k++) {
+        Variable *var = sym_lookup(in, intern(in, t->names[k], (int)strlen(t->names[k])));
+        if (!var) {
+            diag(in, DIAG_ERROR, 0, 0, "the program declares no variable '%s' for column %d",
+                 t->names[k], k + 1);
+            in->had_error = 1;
+            continue;
+        }
+        slots[k]         = var->slot;
+        input[var->slot] = 1;
+    }
+    for (Stmt *s = prog->first; s && !in->had_error; s = s->next) {
+        if (s->kind != S_DECL || !input[s->slot]) continue;
+        Node *col = (Node *)arena_alloc(&in->ast_arena, sizeof(Node));
+        col->kind  = N_VAR;
+        col->value = s->slot;
+        col->line  = s->expr->line;
+        col->col   = s->expr->col;
+        col->lhs   = col->rhs = NULL;
+        s->expr    = col;
+    }
+
+    free(input);
+    if (in->had_error) {
+        free(slots);
+        return NULL;
+    }
+    return slots;
+}
+
+/* Parse, bind, optimise and compile a program, then run it over t */
+static void col_source(Interp *in, const char *src, size_t len, const RowTable *t) {
+    Program prog;
+    int    *slots = NULL;
+    parser_init(in, src, len);
+    sym_reset(in);
+
+    STAT_BEGIN(in);
+    parse_program(in, &prog);
+    STAT_END(in, PHASE_PARSE);
+    if (!in->had_error) slots = col_bind(in, &prog, t);
+    if (!in->had_error && in->opt.optimise) {
+        STAT_BEGIN(in);
+        optimise_program(in, &prog);
+        STAT_END(in, PHASE_OPTIMISE);
+    }
+    if (!in->had_error) {
+        Bytecode bc;
+        memset(&bc, 0, sizeof(bc));
+        compile_timed(in, &bc, &prog);
+        STAT_BEGIN(in);
+        col_execute(in, &bc, t, slots);
+        STAT_END(in, PHASE_EXECUTE);
+        bytecode_free(&bc);
+    }
+
+    free(slots);
+    output_flush(in);
+    arena_reset(&in->ast_arena);
+}
+
+#endif /* !PARSER_NO_MAIN || PARSER_FUZZ */
+
+#ifndef PARSER_NO_MAIN
+
+/* Parse an optional sign and decimal digits at *pp into *value */
+static int rows_value(const char **pp, const char *end, Value *value) {
+    const char *p   = *pp;
+    int         neg = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+
+    uint64_t    v = 0, limit = (uint64_t)VALUE_MAX + (uint64_t)neg;
+    const char *digits = p;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        unsigned d = (unsigned)(*p - '0');
+        if (v > (limit - d) / 10) return -1;
+        v = v * 10 + d;
+    }
+    if (p == digits) return -1;
+    *value = neg ? (Value)(0u - (UValue)v) : (Value)v;
+    *pp    = p;
+    return 0;
+}
+
+static const char *rows_skip_blanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+/* Read the header line's column names */
+static int rows_header(Interp *in, const char *path, const char *p, const char *eol, RowTable *t) {
+    for (;;) {
+        p = rows_skip_blanks(p, eol);
+        const char *name = p;
+        while (p < eol && (*p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                           (p > name && *p >= '0' && *p <= '9')))
+            p++;
+        int len = (int)(p - name);
+        p = rows_skip_blanks(p, eol);
+        if (len == 0 || (p < eol && *p != ',')) {
+            diag(in, DIAG_ERROR, 0, 0, "'%s' line 1: expected variable names separated by commas",
+                 path);
+            return -1;
+        }
+        for (int k = 0; k < t->count; k++) {
+            if ((int)strlen(t->names[k]) == len && memcmp(t->names[k], name, len) == 0) {
+                diag(in, DIAG_ERROR, 0, 0, "'%s' line 1: column '%.*s' is named twice", path, len,
+                     name);
+                return -1;
+            }
+        }
+        t->names  = (char **)xrealloc(t->names, (t->count + 1) * sizeof(char *));
+        t->values = (Value **)xrealloc(t->values, (t->count + 1) * sizeof(Value *));
+        t->names[t->count] = (char *)xmalloc(len + 1);
+        memcpy(t->names[t->count], name, len);
+        t->names[t->count][len] = '\0';
+        t->values[t->count++]   = NULL;
+        if (p == eol) return 0;
+        p++;
+    }
+}
+
+/* Read the rows of values after the header, one line each */
+static int rows_text(Interp *in, const char *path, const char *p, const char *end, RowTable *t) {
+    size_t cap = 0;
+    for (int line = 2; p < end; line++) {
+        const char *nl  = (const char *)memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        p = rows_skip_blanks(p, eol);
+        if (p == eol) {  /* blank line */
+            p = eol < end ? eol + 1 : end;
+            continue;
+        }
+        if (t->rows == cap) {
+            cap = cap ? cap * 2 : 4096;
+            for (int k = 0; k < t->count; k++)
+                t->values[k] = (Value *)xrealloc(t->values[k], cap * sizeof(Value));
+        }
+        for (int k = 0; k < t->count; k++) {
+            p = rows_skip_blanks(p, eol);
+            if (rows_value(&p, eol, &t->values[k][t->rows]) != 0) {
+                diag(in, DIAG_ERROR, 0, 0, "'%s' line %d: value %d is not an integer in range",
+                     path, line, k + 1);
+                return -1;
+            }
+            p = rows_skip_blanks(p, eol);
+            if (k + 1 < t->count ? (p == eol || *p != ',') : p != eol) {
+                diag(in, DIAG_ERROR, 0, 0, "'%s' line %d: expected %d values separated by commas",
+                     path, line, t->count);
+                return -1;
+            }
+            if (k + 1 < t->count) p++;
+        }
+        t->rows++;
+        p = eol < end ? eol + 1 : end;
+    }
+    return 0;
+}
+
+/* Read the columns of raw values after the header, one after another */
+static int rows_binary(Interp *in, const char *path, const char *p, const char *end, RowTable *t) {
+    size_t bytes = (size_t)(end - p), column;
+    if (bytes % ((size_t)t->count * sizeof(Value)) != 0) {
+        diag(in, DIAG_ERROR, 0, 0, "'%s' does not hold %d whole columns of %d-bit values", path,
+             t->count, (int)sizeof(Value) * 8);
+        return -1;
+    }
+    t->rows = bytes / t->count / sizeof(Value);
+    column  = t->rows * sizeof(Value);
+    for (int k = 0; k < t->count; k++) {
+        t->values[k] = (Value *)xmalloc(column + COL_LANES * sizeof(Value));
+        memcpy(t->values[k], p + k * column, column);
+    }
+    return 0;
+}
+
+/* Load the table of a --rows file; returns 0, or -1 after a diagnostic */
+static int rows_load(Interp *in, const char *path, int binary, RowTable *t) {
+    SourceFile source;
+    memset(t, 0, sizeof(*t));
+    if (read_file(in, path, &source) != 0) return -1;
+
+    const char *p   = source.data, *end = p + source.length;
+    const char *nl  = (const char *)memchr(p, '\n', source.length);
+    const char *eol = nl ? nl : end;
+    int rc = rows_header(in, path, p, eol, t);
+    p = nl ? nl + 1 : end;
+    if (rc == 0) rc = binary ? rows_binary(in, path, p, end, t) : rows_text(in, path, p, end, t);
+
+    close_source(&source);
+    if (rc != 0) {
+        free_rows(t);
+        return rc;
+    }
+    for (int k = 0; k < t->count; k++) {  /* zero the padding */
+        for (size_t i = t->rows; i % COL_LANES != 0; i++) t->values[k][i] = 0;
+    }
+    return 0;
+}
+
+/* Run the program at path over the rows of rows_path, like run_file() */
+static int run_rows(Interp *in, const char *path, const char *rows_path, int binary) {
+    SourceFile source;
+    RowTable   table;
+    DiagSink   sink = { in->err_fp, path };
+    if (diag_json) interp_set_diagnostics(in, json_diag, &sink);
+#if SIL_STATS
+    in->stats.file = path;
+#endif
+    if (rows_load(in, rows_path, binary, &table) != 0) return 1;
+    if (read_file(in, path, &source) != 0) {
+        free_rows(&table);
+        return 1;
+    }
+
+    if (source.length >= 4 && memcmp(source.data, "SILC", 4) == 0) {
+        /* A compiled program no longer knows its variables' names */
+        diag(in, DIAG_ERROR, 0, 0, "--rows needs the source of '%s', not a compiled program", path);
+        in->had_error = 1;
+    } else {
+        col_source(in, source.data, source.length, &table);
+    }
+    close_source(&source);
+    free_rows(&table);
+    return run_status(in);
+}
+
+/* ======================== MAIN ======================== */
+
+/* Growable list of source paths from the command line */
+typedef struct {
+    const char **items;
+    int          count;
+    int          cap;
+} PathList;
+
+static void path_add(PathList *pl, const char *path) {
+    if (pl->count == pl->cap) {
+        pl->cap = pl->cap ? pl->cap * 2 : 16;
+        pl->items = (const char **)xrealloc(pl->items, pl->cap * sizeof(char *));
+    }
+    pl->items[pl->count++] = path;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/*
+ * Add path to the list; a directory contributes the regular files
+ * directly inside it, sorted by name.  Returns 1 if path was a directory.
+ */
+static int add_source(PathList *pl, const char *path) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path);
+        if (!dir) {
+            fprintf(stderr, "Error: cannot open directory '%s'\n", path);
+            return 1;
+        }
+        int first = pl->count;
+        struct dirent *de;
+        while ((de = readdir(dir)) != NULL) {
+            if (de->d_name[0] == '.') continue;
+            size_t n    = strlen(path) + strlen(de->d_name) + 2;
+            char  *file = (char *)xmalloc(n);
+            snprintf(file, n, "%s/%s", path, de->d_name);
+            if (stat(file, &st) == 0 && S_ISREG(st.st_mode))
+                path_add(pl, file);
+            else
+                free(file);
+        }
+        closedir(dir);
+        qsort(pl->items + first, pl->count - first, sizeof(char *), compare_paths);
+        return 1;
+    }
+#endif
+    path_add(pl, path);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [--engine=direct|ast|parallel|vm|jit] [--jit] [--no-opt] [--checked]\n"
+        "       %*s [--check] [--compile -o OUT] [--binary-output] [--cache[=DIR]] [--jobs N] [--lex-threads=N]\n"
+        "       %*s [--threads=N] [--max-errors N] [--diagnostics=text|json]\n"
+        "       %*s [--stats] [--trace=chrome[:FILE]] <source_file|directory>...\n"
+        "       %s [options] --rows=FILE [--binary-input] <source_file>\n"
+        "       %s [options] --serve[=PATH]\n",
+        prog, (int)strlen(prog), "", (int)strlen(prog), "", (int)strlen(prog), "", prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    InterpOptions opt   = { ENGINE_DIRECT, 1, 0, 0, 0, NULL, 0, 0, 0, 0 };
+    PathList      paths = { NULL, 0, 0 };
+    const char   *compile_out = NULL;  /* --compile's -o FILE */
+    const char   *serve_path  = NULL;  /* --serve=PATH */
+    const char   *rows_path   = NULL;  /* --rows=FILE */
+    int           binary_in = 0;
+    int           compile = 0;
+    int           serve   = 0;
+    int           jobs  = 0;  /* 0 = single-file mode unless several inputs */
+    int           batch = 0;
+    int           lex_threads_set = 0;
+    int           exec_threads_set = 0;
+
+    /* --- Check command-line arguments --- */
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--engine=direct") == 0) {
+            opt.engine = ENGINE_DIRECT;
+        } else if (strcmp(arg, "--engine=ast") == 0) {
+            opt.engine = ENGINE_AST;
+        } else if (strcmp(arg, "--engine=parallel") == 0) {
+            opt.engine = ENGINE_PARALLEL;
+        } else if (strcmp(arg, "--engine=vm") == 0) {
+            opt.engine = ENGINE_VM;
+        } else if (strcmp(arg, "--engine=jit") == 0 || strcmp(arg, "--jit") == 0) {
+            opt.engine = ENGINE_JIT;
+        } else if (strcmp(arg, "--no-opt") == 0) {
+            opt.optimise = 0;
+        } else if (strcmp(arg, "--binary-output") == 0) {
+            opt.out_binary = 1;
+        } else if (strcmp(arg, "--checked") == 0) {
+            opt.checked = 1;
+        } else if (strcmp(arg, "--check") == 0) {
+            opt.check_only = 1;
+        } else if (strcmp(arg, "--compile") == 0) {
+            compile = 1;
+        } else if (strncmp(arg, "--rows=", 7) == 0 && arg[7]) {
+            rows_path = arg + 7;
+        } else if (strcmp(arg, "--binary-input") == 0) {
+            binary_in = 1;
+        } else if (strcmp(arg, "--serve") == 0) {
+            serve = 1;
+        } else if (strncmp(arg, "--serve=", 8) == 0 && arg[8]) {
+            serve      = 1;
+            serve_path = arg + 8;
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            compile_out = argv[++i];
+        } else if (strncmp(arg, "--lex-threads=", 14) == 0) {
+            opt.lex_threads = atoi(arg + 14);
+            lex_threads_set = 1;
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            opt.exec_threads = atoi(arg + 10);
+            exec_threads_set = 1;
+        } else if (strcmp(arg, "--stats") == 0 || strncmp(arg, "--trace=", 8) == 0) {
+#if SIL_STATS
+            if (arg[2] == 's') {
+                stats_report = 1;
+            } else if (strcmp(arg + 8, "chrome") == 0) {
+                trace_path = "trace.json";
+            } else if (strncmp(arg + 8, "chrome:", 7) == 0 && arg[15]) {
+                trace_path = arg + 15;
+            } else {
+                fprintf(stderr, "Error: --trace takes chrome or chrome:FILE\n");
+                return 1;
+            }
+#else
+            fprintf(stderr, "Error: %s needs a build with -DSIL_STATS\n", arg);
+            return 1;
+#endif
+        } else if (strcmp(arg, "--cache") == 0) {
+            opt.cache_dir = CACHE_DEFAULT_DIR;
+        } else if (strncmp(arg, "--cache=", 8) == 0) {
+            opt.cache_dir = arg + 8;
+        } else if (strcmp(arg, "--jobs") == 0 || strncmp(arg, "--jobs=", 7) == 0) {
+            const char *n = arg[6] == '=' ? arg + 7 : (i + 1 < argc ? argv[++i] : "");
+            jobs = atoi(n);
+            if (jobs < 1) {
+                fprintf(stderr, "Error: --jobs needs a positive number\n");
+                return 1;
+            }
+            batch = 1;
+        } else if (strcmp(arg, "--max-errors") == 0 || strncmp(arg, "--max-errors=", 13) == 0) {
+            const char *n = arg[12] == '=' ? arg + 13 : (i + 1 < argc ? argv[++i] : "");
+            opt.max_errors = atoi(n);
+            if (opt.max_errors < 1) {
+                fprintf(stderr, "Error: --max-errors needs a positive number\n");
+                return 1;
+            }
+        } else if (strcmp(arg, "--diagnostics=text") == 0) {
+            diag_json = 0;
+        } else if (strcmp(arg, "--diagnostics=json") == 0) {
+            diag_json = 1;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            fprintf(stderr, "Error: unknown option '%s'\n", arg);
+            usage(argv[0]);
+            return 1;
+        } else {
+            if (add_source(&paths, arg)) batch = 1;
+        }
+    }
+    if (serve && (batch || paths.count > 0 || compile)) {
+        fprintf(stderr, "Error: --serve takes no input files\n");
+        return 1;
+    }
+    if (serve && opt.check_only) {
+        fprintf(stderr, "Error: --serve runs every request; it cannot be used with --check\n");
+        return 1;
+    }
+    if (rows_path && (batch || paths.count != 1 || compile || serve || opt.check_only)) {
+        fprintf(stderr, "Error: --rows takes one source file\n");
+        return 1;
+    }
+    if (binary_in && !rows_path) {
+        fprintf(stderr, "Error: --binary-input needs --rows=FILE\n");
+        return 1;
+    }
+    if (paths.count == 0 && !batch && !serve) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (compile && (batch || paths.count != 1 || !compile_out)) {
+        fprintf(stderr, "Error: --compile takes one source file and -o FILE\n");
+        return 1;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    /* Lex large inputs and run parallel programs on every CPU unless
+       told otherwise */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 8) cpus = 8;
+    if (!lex_threads_set) opt.lex_threads = (int)cpus;
+    if (!exec_threads_set) opt.exec_threads = (int)cpus;
+#endif
+
+#if SIL_STATS
+    if (trace_path) trace_log.epoch = stats_now();
+#endif
+    if (diag_json) setvbuf(stderr, NULL, _IOFBF, 64 * 1024);
+
+    int status = 0;
+    if (serve && serve_path) {
+#if defined(__unix__) || defined(__APPLE__)
+        status = serve_socket(&opt, serve_path);
+#else
+        fprintf(stderr, "Error: --serve=PATH needs Unix sockets\n");
+        status = 1;
+#endif
+    } else if (serve) {
+        serve_session(&opt, 0, stdout);
+    } else if (!batch && paths.count == 1) {
+        Interp *in = (Interp *)xmalloc(sizeof(Interp));
+        interp_init(in, stdout, stderr);
+        in->opt = opt;
+        if (compile)
+            status = compile_file(in, paths.items[0], compile_out);
+        else if (rows_path)
+            status = run_rows(in, paths.items[0], rows_path, binary_in);
+        else
+            status = run_file(in, paths.items[0]);
+        interp_release(in);
+        free(in);
+    } else {
+        status = run_batch(paths.items, paths.count, &opt, jobs > 0 ? jobs : 1);
+    }
+#if SIL_STATS
+    if (trace_path && trace_write(trace_path) != 0) {
+        fprintf(stderr, "Error: cannot write trace file '%s'\n", trace_path);
+        status = 1;
+    }
+#endif
+
+    free(paths.items); /* directory entries are left to process exit */
+    return status;
+}
+
+#endif /* PARSER_NO_MAIN */
@@ -0,0 +1,152 @@
+/*
+ * parser.h - Embedding interface for the Simple Integer Language
+ * ==============================================================
+ * Lets a host program run SIL source held in memory without spawning
+ * the ./parser executable.  Build parser.c without its main():
+ *
+ *     gcc -O2 -pthread -DPARSER_NO_MAIN -c parser.c
+ *
+ * and link parser.o into the host.  Each Interp is independent: any
+ * number of them may be used at once from different threads, but a
+ * single Interp must only be used by one thread at a time.
+ *
+ * Typical use:
+ *
+ *     Interp *in = interp_create(NULL);
+ *     interp_set_output(in, on_output, ctx);
+ *     interp_set_diagnostics(in, on_diag, ctx);
+ *     int status = interp_run_string(in, src, len);
+ *     ...
+ *     interp_destroy(in);
+ */
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Opaque interpreter context */
+typedef struct Interp Interp;
+
+/* Execution engines (see the Options list at the top of parser.c) */
+typedef enum {
+    ENGINE_DIRECT, /* execute each statement as it is parsed (default) */
+    ENGINE_AST,    /* parse the whole program, then walk the AST        */
+    ENGINE_VM,     /* compile the program to bytecode and run the VM    */
+    ENGINE_JIT,    /* compile bytecode to native code (VM as fallback)  */
+    ENGINE_PARALLEL /* walk the AST, running independent statements on
+                       exec_threads threads                           */
+} Engine;
+
+/* Per-context settings; interp_create(NULL) uses { ENGINE_DIRECT, 1 } */
+typedef struct {
+    Engine      engine;
+    int         optimise;    /* fold constants and share subexpressions  */
+    int         out_binary;  /* print() emits native-endian values       */
+    int         checked;     /* report overflow instead of wrapping      */
+    int         cache_size;  /* compiled programs kept in memory (vm and
+                                jit engines); 0 disables the cache       */
+    const char *cache_dir;   /* if set, compiled programs are also saved
+                                here and reused by later processes       */
+    int         lex_threads; /* threads lexing large inputs ahead of the
+                                parser; 0 or 1 lexes serially            */
+    int         exec_threads; /* threads for ENGINE_PARALLEL; 0 or 1
+                                 runs it serially                        */
+    int         max_errors;  /* stop parsing at this many diagnostics in
+                                one run; 0 means no limit                */
+    int         check_only;  /* lex, parse and check the program without
+                                running it; the engine is ignored, and a
+                                compiled program is only verified        */
+} InterpOptions;
+
+/* Counters for the compiled-program cache */
+typedef struct {
+    unsigned long hits;       /* found in memory                   */
+    unsigned long disk_hits;  /* loaded from cache_dir             */
+    unsigned long misses;     /* lexed, parsed and compiled afresh */
+} InterpCacheStats;
+
+/* Diagnostic categories; each prints as "<Kind> Error" */
+typedef enum {
+    DIAG_ERROR,    /* "Error: ..." with no source position */
+    DIAG_LEXICAL,
+    DIAG_SYNTAX,
+    DIAG_SEMANTIC,
+    DIAG_RUNTIME
+} DiagKind;
+
+/*
+ * Receives print() output in chunks of up to 64 KB.  data is not
+ * NUL-terminated and is only valid for the duration of the call.
+ */
+typedef void (*InterpOutputFn)(void *user, const char *data, size_t len);
+
+/*
+ * Receives one diagnostic.  col is 0 when the diagnostic has no column,
+ * and line is 0 for DIAG_ERROR.  msg is the text after the position.
+ */
+typedef void (*InterpDiagFn)(void *user, DiagKind kind, int line, int col,
+                             const char *msg);
+
+/* Create a context; output goes to stdout and diagnostics to stderr
+ * until callbacks are installed.  opt may be NULL. */
+Interp *interp_create(const InterpOptions *opt);
+
+/* Route print() output to fn (NULL restores stdout) */
+void interp_set_output(Interp *in, InterpOutputFn fn, void *user);
+
+/* Route diagnostics to fn (NULL restores stderr) */
+void interp_set_diagnostics(Interp *in, InterpDiagFn fn, void *user);
+
+/*
+ * Run len bytes of source; src need not be NUL-terminated.  Variables
+ * do not carry over between calls, but the memory a run needs is kept:
+ * running the same program again on the same context allocates nothing
+ * (except with ENGINE_PARALLEL).  Returns 0 on success and 1 if any
+ * error was reported.
+ */
+int interp_run_string(Interp *in, const char *src, size_t len);
+
+/*
+ * Run a program precompiled by `parser --compile` (a .silc file), held
+ * in len bytes at data.  data must be 8-byte aligned, as memory from
+ * mmap() or malloc() is; the program runs in place, without a copy.
+ * The jit engine runs it natively and every other engine on the VM.
+ * Returns 0 or 1 like interp_run_string(); an image that is damaged or
+ * was written for another version or machine is reported as an error.
+ */
+int interp_run_compiled(Interp *in, const void *data, size_t len);
+
+/*
+ * Like interp_run_string(), but keep the program for interp_rerun().
+ * It always runs as the ast engine would, without sharing common
+ * subexpressions.  Any later interp_run_string() or
+ * interp_run_retained() call discards the kept program.
+ */
+int interp_run_retained(Interp *in, const char *src, size_t len);
+
+/*
+ * Run the kept program again as if variable name had been declared
+ * `int name = value;`.  Patches accumulate across calls.  Only the
+ * statements that depend on name are evaluated again; the output and
+ * diagnostics are those of running the patched source.  Returns 0 or 1
+ * like interp_run_string(), or -1 if no program is kept, it does not
+ * declare name, or value is out of range.
+ */
+int interp_rerun(Interp *in, const char *name, long long value);
+
+/* Read the cache counters of a context */
+void interp_cache_stats(const Interp *in, InterpCacheStats *stats);
+
+/* Free a context and everything it owns */
+void interp_destroy(Interp *in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PARSER_H */